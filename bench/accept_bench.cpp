@@ -0,0 +1,93 @@
+// Connection storm benchmark: opens many raw TCP connections to a WSServer
+// at once, as devices do after an access point reboot, and measures how
+// long the server takes to upgrade all of them.
+//
+// Usage: accept_bench [--port=8766] [--connections=200] [--batch=16]
+
+#include <atomic>
+#include <thread>
+
+#include "BenchUtil.h"
+#include "WSServer.h"
+
+static const char* request =
+    "GET / HTTP/1.1\r\n"
+    "Host: 127.0.0.1\r\n"
+    "Upgrade: websocket\r\n"
+    "Connection: Upgrade\r\n"
+    "Sec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\n"
+    "Sec-WebSocket-Version: 13\r\n"
+    "\r\n";
+
+static int openConnection(uint16_t port) {
+    int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) return -1;
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons(port);
+    if (::connect(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0 || ::send(fd, request, strlen(request), MSG_NOSIGNAL) < 0) {
+        ::close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// Reads until the end of the response headers; true on 101.
+static bool readUpgrade(int fd) {
+    std::string response;
+    char buf[256];
+    while (response.find("\r\n\r\n") == std::string::npos) {
+        ssize_t n = ::recv(fd, buf, sizeof(buf), 0);
+        if (n <= 0) return false;
+        response.append(buf, n);
+    }
+    return response.compare(0, 12, "HTTP/1.1 101") == 0;
+}
+
+int main(int argc, char** argv) {
+    uint16_t port = bench::option(argc, argv, "port", 8766);
+    long connections = bench::option(argc, argv, "connections", 200);
+    long batch = bench::option(argc, argv, "batch", WS_ACCEPT_BATCH);
+
+    std::atomic<bool> stop(false);
+    std::atomic<int> maxBacklog(-1);
+    WSServer server(port, 255);
+    server.setAcceptBatch(batch);
+    server.begin();
+    std::thread serverThread([&]() {
+        while (!stop) {
+            server.run();
+            int backlog = server.getAcceptStats().backlog;
+            if (backlog > maxBacklog) maxBacklog = backlog;
+            yield();
+        }
+    });
+
+    std::vector<int> fds;
+    bench::Clock::time_point start = bench::Clock::now();
+    for (long i = 0; i < connections; i++) {
+        int fd = openConnection(port);
+        if (fd < 0) {
+            fprintf(stderr, "connect failed after %ld connections\n", i);
+            break;
+        }
+        fds.push_back(fd);
+    }
+    long upgraded = 0;
+    for (int fd : fds) {
+        if (readUpgrade(fd)) upgraded++;
+    }
+    double seconds = bench::secondsSince(start);
+
+    stop = true;
+    serverThread.join();
+    WSServer::AcceptStats stats = server.getAcceptStats();
+    for (int fd : fds) ::close(fd);
+
+    printf("connections  %ld upgraded in %.3f s\n", upgraded, seconds);
+    printf("rate         %.0f conn/s\n", upgraded / seconds);
+    printf("server       accepted %u, rejected %u, max backlog %d\n", stats.accepted, stats.rejected, (int)maxBacklog);
+    return upgraded == connections ? 0 : 1;
+}
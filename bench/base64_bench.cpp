@@ -0,0 +1,107 @@
+// Base64 throughput: the original String-building codec against the
+// table-driven portable code and the vector path chosen for this host, for
+// encoding and decoding.
+//
+// Usage: base64_bench [--bytes=67108864]
+
+#include "BenchUtil.h"
+#include "utilities/Base64.h"
+
+static const String chars = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+// Base64::encode before the lookup tables: one String append per character.
+static String legacyEncode(const uint8_t* bytes, size_t len) {
+    String ret;
+    int i = 0;
+    uint8_t a3[3];
+    uint8_t a4[4];
+    while (len--) {
+        a3[i++] = *(bytes++);
+        if (i == 3) {
+            a4[0] = (a3[0] & 0xfc) >> 2;
+            a4[1] = ((a3[0] & 0x03) << 4) + ((a3[1] & 0xf0) >> 4);
+            a4[2] = ((a3[1] & 0x0f) << 2) + ((a3[2] & 0xc0) >> 6);
+            a4[3] = a3[2] & 0x3f;
+            for (i = 0; i < 4; i++) ret += chars[a4[i]];
+            i = 0;
+        }
+    }
+    if (i) {
+        for (int j = i; j < 3; j++) a3[j] = '\0';
+        a4[0] = (a3[0] & 0xfc) >> 2;
+        a4[1] = ((a3[0] & 0x03) << 4) + ((a3[1] & 0xf0) >> 4);
+        a4[2] = ((a3[1] & 0x0f) << 2) + ((a3[2] & 0xc0) >> 6);
+        for (int j = 0; j < i + 1; j++) ret += chars[a4[j]];
+        while (i++ < 3) ret += '=';
+    }
+    return ret;
+}
+
+// Base64::decode before the lookup tables: indexOf() per character.
+static String legacyDecode(const String& encoded) {
+    int len = encoded.length();
+    int i = 0;
+    int in = 0;
+    uint8_t a3[3];
+    uint8_t a4[4];
+    String ret;
+    while (len-- && encoded[in] != '=' && (isalnum(encoded[in]) || encoded[in] == '+' || encoded[in] == '/')) {
+        a4[i++] = encoded[in++];
+        if (i == 4) {
+            for (i = 0; i < 4; i++) a4[i] = chars.indexOf(a4[i]);
+            a3[0] = (a4[0] << 2) + ((a4[1] & 0x30) >> 4);
+            a3[1] = ((a4[1] & 0xf) << 4) + ((a4[2] & 0x3c) >> 2);
+            a3[2] = ((a4[2] & 0x3) << 6) + a4[3];
+            for (i = 0; i < 3; i++) ret += (char)a3[i];
+            i = 0;
+        }
+    }
+    if (i) {
+        for (int j = i; j < 4; j++) a4[j] = 0;
+        for (int j = 0; j < 4; j++) a4[j] = chars.indexOf(a4[j]);
+        a3[0] = (a4[0] << 2) + ((a4[1] & 0x30) >> 4);
+        a3[1] = ((a4[1] & 0xf) << 4) + ((a4[2] & 0x3c) >> 2);
+        for (int j = 0; j < i - 1; j++) ret += (char)a3[j];
+    }
+    return ret;
+}
+
+template <typename Fn>
+static double measure(size_t size, size_t totalBytes, Fn fn) {
+    size_t rounds = std::max<size_t>(1, totalBytes / size);
+    bench::Clock::time_point start = bench::Clock::now();
+    for (size_t r = 0; r < rounds; r++) fn();
+    return rounds * size / bench::secondsSince(start);
+}
+
+int main(int argc, char** argv) {
+    size_t totalBytes = bench::option(argc, argv, "bytes", 64L << 20);
+    const size_t sizes[] = {16, 128, 1024, 16384, 1048576};
+
+    printf("vector backend: %s (rates are of raw bytes)\n", Base64::backend());
+    printf("%9s %11s %11s %11s %11s %11s %11s\n", "size", "enc legacy", "enc table", "enc vector", "dec legacy", "dec table", "dec vector");
+    for (size_t size : sizes) {
+        std::vector<uint8_t> data(size);
+        for (size_t i = 0; i < size; i++) data[i] = i * 131 + 7;
+        std::vector<char> text(Base64::encodedSize(size));
+        std::vector<uint8_t> decoded(size);
+        size_t textLen = Base64::encode(data.data(), size, text.data());
+        size_t decodedLen = 0;
+        String legacy = legacyEncode(data.data(), size);
+        if (legacy.length() != textLen || memcmp(legacy.c_str(), text.data(), textLen) || !Base64::decode(text.data(), textLen, decoded.data(), decodedLen) || decoded != data) {
+            fprintf(stderr, "round trip mismatch at size %zu\n", size);
+            return 1;
+        }
+
+        size_t legacyBytes = std::min<size_t>(totalBytes, 8L << 20);
+        double legacyEnc = measure(size, legacyBytes, [&]() { legacyEncode(data.data(), size); });
+        double tableEnc = measure(size, totalBytes, [&]() { Base64::encodePortable(data.data(), size, text.data()); });
+        double vectorEnc = measure(size, totalBytes, [&]() { Base64::encode(data.data(), size, text.data()); });
+        double legacyDec = measure(size, legacyBytes, [&]() { legacyDecode(legacy); });
+        double tableDec = measure(size, totalBytes, [&]() { Base64::decodePortable(text.data(), textLen, decoded.data(), decodedLen); });
+        double vectorDec = measure(size, totalBytes, [&]() { Base64::decode(text.data(), textLen, decoded.data(), decodedLen); });
+        printf("%9zu %11s %11s %11s %11s %11s %11s\n", size, bench::humanBytes(legacyEnc).c_str(), bench::humanBytes(tableEnc).c_str(), bench::humanBytes(vectorEnc).c_str(),
+               bench::humanBytes(legacyDec).c_str(), bench::humanBytes(tableDec).c_str(), bench::humanBytes(vectorDec).c_str());
+    }
+    return 0;
+}
@@ -0,0 +1,102 @@
+// Broadcast cost benchmark: holds N raw WebSocket connections open against
+// a WSServer and measures one broadcast() to all of them against the
+// per-client loop of send() calls it replaces, for growing N.
+//
+// Usage: broadcast_bench [--port=8769] [--connections=1000] [--size=256] [--rounds=200]
+
+#include "BenchUtil.h"
+#include "WSServer.h"
+
+static const char* request =
+    "GET / HTTP/1.1\r\n"
+    "Host: 127.0.0.1\r\n"
+    "Upgrade: websocket\r\n"
+    "Connection: Upgrade\r\n"
+    "Sec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\n"
+    "Sec-WebSocket-Version: 13\r\n"
+    "\r\n";
+
+static int openConnection(uint16_t port) {
+    int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) return -1;
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons(port);
+    if (::connect(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0 || ::send(fd, request, strlen(request), MSG_NOSIGNAL) < 0) {
+        ::close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// Runs the server until fd has bytes to read, then drains them.
+static bool await(WSServer& server, int fd) {
+    uint8_t buf[512];
+    for (long i = 0; i < 1000000; i++) {
+        if (::recv(fd, buf, sizeof(buf), MSG_DONTWAIT) > 0) return true;
+        server.run();
+    }
+    return false;
+}
+
+// Reads everything the server sent so socket buffers never fill up.
+static void drain(const std::vector<int>& fds) {
+    static uint8_t buf[65536];
+    for (int fd : fds) {
+        while (::recv(fd, buf, sizeof(buf), MSG_DONTWAIT) > 0) {
+        }
+    }
+}
+
+int main(int argc, char** argv) {
+    uint16_t port = bench::option(argc, argv, "port", 8769);
+    long connections = bench::option(argc, argv, "connections", 1000);
+    long size = bench::option(argc, argv, "size", 256);
+    long rounds = bench::option(argc, argv, "rounds", 200);
+
+    std::string text(size, 'x');
+    String payload(text.c_str());
+
+    WSServer server(port, 255);
+    server.begin();
+    std::vector<int> fds;
+
+    printf("%-8s %14s %14s %14s %8s\n", "conns", "loop us", "broadcast us", "per conn ns", "speedup");
+    for (long n = 10; n <= connections; n *= 10) {
+        while ((long)fds.size() < n) {
+            int fd = openConnection(port);
+            if (fd < 0 || !await(server, fd)) {
+                fprintf(stderr, "connection %zu failed\n", fds.size());
+                if (fd >= 0) ::close(fd);
+                break;
+            }
+            fds.push_back(fd);
+        }
+
+        double loop = 0;
+        double broadcast = 0;
+        for (long r = 0; r < rounds; r++) {
+            bench::Clock::time_point start = bench::Clock::now();
+            for (auto& c : server.getClients()) {
+                c.send(payload);
+            }
+            loop += bench::microsSince(start);
+            drain(fds);
+
+            start = bench::Clock::now();
+            server.broadcast(payload);
+            broadcast += bench::microsSince(start);
+            drain(fds);
+        }
+        loop /= rounds;
+        broadcast /= rounds;
+        printf("%-8zu %14.1f %14.1f %14.1f %7.2fx\n", fds.size(), loop, broadcast, broadcast * 1000 / fds.size(), loop / broadcast);
+        if (n < connections && n * 10 > connections) n = connections / 10;
+    }
+
+    for (int fd : fds) ::close(fd);
+    server.end();
+    return 0;
+}
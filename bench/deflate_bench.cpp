@@ -0,0 +1,105 @@
+// permessage-deflate cost: compression ratio and CPU time per message for
+// representative payloads under different window and context settings.
+//
+// Usage: deflate_bench [--messages=20000]
+
+#include "BenchUtil.h"
+#include "utilities/Deflate.h"
+
+struct Setting {
+    const char* name;
+    uint8_t windowBits;
+    bool noContextTakeover;
+    uint8_t memLevel;
+};
+
+static std::string telemetry(long i) {
+    char buf[256];
+    snprintf(buf, sizeof(buf),
+             "{\"device\":\"esp32-%04ld\",\"ts\":%ld,\"temp\":%.2f,\"hum\":%.1f,\"rssi\":%ld,\"batt\":%.2f,\"status\":\"ok\"}",
+             i % 64, 1697040000123L + i * 1000, 20 + (i % 700) / 100.0, 40 + (i % 300) / 10.0, -40 - i % 50, 3.3 + (i % 90) / 100.0);
+    return buf;
+}
+
+static std::string batch(long i) {
+    std::string out = "[";
+    for (int j = 0; j < 24; j++) out += (j ? "," : "") + telemetry(i * 24 + j);
+    return out + "]";
+}
+
+static std::string randomBytes(long i) {
+    std::string out(1024, 0);
+    uint32_t x = (uint32_t)(i + 1) * 2654435761u;
+    for (auto& c : out) {
+        x ^= x << 13;
+        x ^= x >> 17;
+        x ^= x << 5;
+        c = x;
+    }
+    return out;
+}
+
+int main(int argc, char** argv) {
+    long messages = bench::option(argc, argv, "messages", 20000);
+    const Setting settings[] = {
+        {"w15 takeover", 15, false, 8},
+        {"w15 no-takeover", 15, true, 8},
+        {"w10 takeover", 10, false, 8},
+        {"w10 no-takeover", 10, true, 8},
+        {"w9 mem1 takeover", 9, false, 1},
+    };
+    struct Payload {
+        const char* name;
+        std::string (*make)(long);
+    } payloads[] = {{"telemetry json", telemetry}, {"json batch", batch}, {"random 1k", randomBytes}};
+
+    if (!Deflate::isAvailable()) {
+        fprintf(stderr, "built without permessage-deflate support\n");
+        return 1;
+    }
+
+    printf("%-16s %-18s %10s %8s %12s %12s\n", "payload", "setting", "avg bytes", "ratio", "deflate us", "inflate us");
+    for (const Payload& payload : payloads) {
+        long count = payload.make == telemetry ? messages : messages / 10;
+        std::vector<std::string> inputs;
+        size_t original = 0;
+        for (long i = 0; i < count; i++) {
+            inputs.push_back(payload.make(i));
+            original += inputs.back().size();
+        }
+
+        for (const Setting& setting : settings) {
+            Deflate::Config config;
+            config.deflateWindowBits = config.inflateWindowBits = setting.windowBits;
+            config.deflateNoContextTakeover = config.inflateNoContextTakeover = setting.noContextTakeover;
+            config.memLevel = setting.memLevel;
+            Deflate sender(config);
+            Deflate receiver(config);
+
+            std::vector<std::vector<uint8_t>> compressed(inputs.size());
+            size_t compressedBytes = 0;
+            bench::Clock::time_point start = bench::Clock::now();
+            for (size_t i = 0; i < inputs.size(); i++) {
+                sender.compress((const uint8_t*)inputs[i].data(), inputs[i].size(), compressed[i]);
+                compressedBytes += compressed[i].size();
+            }
+            double deflateTime = bench::microsSince(start);
+
+            std::vector<uint8_t> out;
+            start = bench::Clock::now();
+            for (size_t i = 0; i < inputs.size(); i++) {
+                size_t outLen = 0;
+                Deflate::Result res = receiver.decompress(compressed[i].data(), compressed[i].size(), true, out, outLen, 1 << 20);
+                if (res != Deflate::Ok || outLen != inputs[i].size() || memcmp(out.data(), inputs[i].data(), outLen) != 0) {
+                    fprintf(stderr, "round trip failed for %s / %s\n", payload.name, setting.name);
+                    return 1;
+                }
+            }
+            double inflateTime = bench::microsSince(start);
+
+            printf("%-16s %-18s %10zu %7.1f%% %12.2f %12.2f\n", payload.name, setting.name, original / inputs.size(),
+                   100.0 * compressedBytes / original, deflateTime / inputs.size(), inflateTime / inputs.size());
+        }
+    }
+    return 0;
+}
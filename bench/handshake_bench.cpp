@@ -0,0 +1,196 @@
+// Handshake parsing benchmark: the String-based parser the library used to
+// have against HandshakeParser, for a browser's upgrade request on the
+// server side and a server's 101 response on the client side. Each
+// handshake includes computing or checking the accept key. Heap allocations
+// are counted by replacing operator new.
+//
+// Usage: handshake_bench [--rounds=200000]
+
+#include <new>
+
+#include "BenchUtil.h"
+#include "utilities/Crypto.h"
+#include "utilities/HandshakeParser.h"
+
+static size_t allocations = 0;
+
+void* operator new(size_t size) {
+    allocations++;
+    void* ptr = malloc(size ? size : 1);
+    if (!ptr) throw std::bad_alloc();
+    return ptr;
+}
+
+void operator delete(void* ptr) noexcept {
+    free(ptr);
+}
+
+// What Chrome sends, cookies aside.
+static const char* request =
+    "GET /ws HTTP/1.1\r\n"
+    "Host: 192.168.4.1:81\r\n"
+    "Connection: Upgrade\r\n"
+    "Pragma: no-cache\r\n"
+    "Cache-Control: no-cache\r\n"
+    "User-Agent: Mozilla/5.0 (X11; Linux x86_64) AppleWebKit/537.36 (KHTML, like Gecko) Chrome/120.0.0.0 Safari/537.36\r\n"
+    "Upgrade: websocket\r\n"
+    "Origin: http://192.168.4.1\r\n"
+    "Sec-WebSocket-Version: 13\r\n"
+    "Accept-Encoding: gzip, deflate\r\n"
+    "Accept-Language: en-US,en;q=0.9\r\n"
+    "Sec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\n"
+    "Sec-WebSocket-Extensions: permessage-deflate; client_max_window_bits\r\n"
+    "\r\n";
+
+static const char* response =
+    "HTTP/1.1 101 Switching Protocols\r\n"
+    "Connection: Upgrade\r\n"
+    "Upgrade: websocket\r\n"
+    "Sec-WebSocket-Version: 13\r\n"
+    "Sec-WebSocket-Accept: s3pPLMBiTxaQ9kYGzzhZRbK+xOo=\r\n"
+    "Sec-WebSocket-Extensions: permessage-deflate\r\n"
+    "\r\n";
+
+static const char* expectedAccept = "s3pPLMBiTxaQ9kYGzzhZRbK+xOo=";
+
+// How WSServer split a request into lines before HandshakeParser.
+static std::vector<String> splitLines(const String& text) {
+    std::vector<String> lines;
+    unsigned int start = 0;
+    while (start < text.length()) {
+        int end = text.indexOf('\n', start);
+        if (end < 0) end = text.length();
+        String line = text.substring(start, end);
+        line.trim();
+        start = end + 1;
+        lines.push_back(line);
+        if (!line.length()) break;
+    }
+    return lines;
+}
+
+// Crypto::parseHandshakeRequest before HandshakeParser.
+static bool legacyRequest(std::vector<String> requestHeaders, String& accept, String& extensions) {
+    bool isUpgrade = false;
+    bool isConnection = false;
+    bool isSecWebSocketKey = false;
+    bool isSecWebSocketVersion = false;
+    String handshakeKey;
+
+    for (String header : requestHeaders) {
+        int colonIndex = header.indexOf(':');
+        String key = header.substring(0, colonIndex);
+        String value = header.substring(colonIndex + 1);
+        key.trim();
+        value.trim();
+        key.toLowerCase();
+
+        if (key.equals("connection")) {
+            value.toLowerCase();
+            isConnection = value.equals("upgrade");
+        } else if (key.equals("upgrade")) {
+            value.toLowerCase();
+            isUpgrade = value.equals("websocket");
+        } else if (key.equals("sec-websocket-version")) {
+            isSecWebSocketVersion = value.equals("13");
+        } else if (key.equals("sec-websocket-key")) {
+            isSecWebSocketKey = !value.isEmpty();
+            handshakeKey = value;
+        } else if (key.equals("sec-websocket-extensions")) {
+            extensions += (extensions.length() ? ", " : "") + value;
+        }
+    }
+    accept = Crypto::generateHandshakeKey(handshakeKey);
+    return isUpgrade && isConnection && isSecWebSocketKey && isSecWebSocketVersion;
+}
+
+// Crypto::parseHandshakeResponse before HandshakeParser.
+static bool legacyResponse(std::vector<String> responseHeaders, String& extensions) {
+    bool didUpgradeToWebsockets = false;
+    bool isConnectionUpgraded = false;
+    String serverAccept = "";
+
+    for (String header : responseHeaders) {
+        int colonIndex = header.indexOf(':');
+        String key = header.substring(0, colonIndex);
+        String value = header.substring(colonIndex + 1);
+        key.trim();
+        value.trim();
+        key.toLowerCase();
+
+        if (key.equals("upgrade")) {
+            value.toLowerCase();
+            didUpgradeToWebsockets = value.equals("websocket");
+        } else if (key.equals("connection")) {
+            value.toLowerCase();
+            isConnectionUpgraded = value.equals("upgrade");
+        } else if (key.equals("sec-websocket-accept")) {
+            serverAccept = value;
+        } else if (key.equals("sec-websocket-extensions")) {
+            extensions += (extensions.length() ? ", " : "") + value;
+        }
+    }
+    return serverAccept.equals(expectedAccept) && didUpgradeToWebsockets && isConnectionUpgraded;
+}
+
+struct Result {
+    double rate;
+    double allocations;
+};
+
+template <typename Fn>
+static Result measure(long rounds, Fn fn) {
+    size_t before = allocations;
+    bench::Clock::time_point start = bench::Clock::now();
+    for (long r = 0; r < rounds; r++) {
+        if (!fn()) {
+            fprintf(stderr, "handshake rejected\n");
+            exit(1);
+        }
+    }
+    double seconds = bench::secondsSince(start);
+    return {rounds / seconds, (double)(allocations - before) / rounds};
+}
+
+static void report(const char* name, Result legacy, Result parser) {
+    printf("%-10s %14.0f %14.0f %8.2fx %12.1f %12.1f\n", name, legacy.rate, parser.rate, parser.rate / legacy.rate, legacy.allocations, parser.allocations);
+}
+
+int main(int argc, char** argv) {
+    long rounds = bench::option(argc, argv, "rounds", 200000);
+    String requestText(request);
+    String responseText(response);
+    size_t requestLen = strlen(request);
+    size_t responseLen = strlen(response);
+
+    printf("%-10s %14s %14s %9s %12s %12s\n", "side", "legacy hs/s", "parser hs/s", "speedup", "legacy alloc", "parser alloc");
+
+    Result legacy = measure(rounds, [&]() {
+        String accept, extensions;
+        return legacyRequest(splitLines(requestText), accept, extensions) && accept.equals(expectedAccept);
+    });
+    Result parser = measure(rounds, [&]() {
+        HandshakeParser parser;
+        size_t consumed;
+        parser.feed((const uint8_t*)request, requestLen, consumed);
+        char accept[SHA1_BASE64_SIZE];
+        parser.acceptKey(accept);
+        return parser.isUpgrade() && !strcmp(accept, expectedAccept);
+    });
+    report("server", legacy, parser);
+
+    legacy = measure(rounds, [&]() {
+        String extensions;
+        std::vector<String> lines = splitLines(responseText);
+        if (!lines[0].startsWith("HTTP/1.1 101")) return false;
+        return legacyResponse(lines, extensions);
+    });
+    parser = measure(rounds, [&]() {
+        HandshakeParser parser(HandshakeParser::Response);
+        size_t consumed;
+        parser.feed((const uint8_t*)response, responseLen, consumed);
+        return parser.isUpgrade() && !strcmp(parser.key(), expectedAccept);
+    });
+    report("client", legacy, parser);
+    return 0;
+}
@@ -0,0 +1,58 @@
+// Masking throughput: the original byte-at-a-time String loop against the
+// portable word-wide kernel, the best SIMD kernel for this host, and the
+// fused mask-and-copy used by the frame writer.
+//
+// Usage: mask_bench [--bytes=268435456]
+
+#include "BenchUtil.h"
+#include "utilities/Mask.h"
+
+// The implementation Crypto::remaskData used before Mask existed.
+static void remaskString(String& data, uint8_t maskingKey[4]) {
+    for (unsigned int i = 0; i < data.length(); i++) {
+        data.setCharAt(i, data[i] ^ maskingKey[i % 4]);
+    }
+}
+
+template <typename Fn>
+static double measure(size_t size, size_t totalBytes, Fn fn) {
+    size_t rounds = std::max<size_t>(1, totalBytes / size);
+    bench::Clock::time_point start = bench::Clock::now();
+    for (size_t r = 0; r < rounds; r++) fn();
+    return rounds * size / bench::secondsSince(start);
+}
+
+int main(int argc, char** argv) {
+    size_t totalBytes = bench::option(argc, argv, "bytes", 256L << 20);
+    uint8_t key[4] = {0x37, 0xfa, 0x21, 0x3d};
+    const size_t sizes[] = {16, 125, 1024, 16384, 65536, 1048576};
+
+    printf("simd backend: %s\n", Mask::backend());
+    printf("%10s %14s %14s %14s %14s\n", "size", "string/s", "portable/s", "simd/s", "copy/s");
+    for (size_t size : sizes) {
+        std::vector<uint8_t> buffer(size + 1);
+        for (size_t i = 0; i < buffer.size(); i++) buffer[i] = 'a' + i % 26;
+        std::string text(buffer.begin(), buffer.end() - 1);
+        String str(text.c_str());
+
+        // Check both kernels against the reference, on a misaligned buffer.
+        std::vector<uint8_t> expected(buffer.begin() + 1, buffer.end());
+        for (size_t i = 0; i < size; i++) expected[i] ^= key[(i + 3) % 4];
+        std::vector<uint8_t> a(buffer), b(buffer), c(size);
+        Mask::apply(a.data() + 1, size, key, 3);
+        Mask::applyPortable(b.data() + 1, size, key, 3);
+        Mask::copy(c.data(), buffer.data() + 1, size, key, 3);
+        if (!std::equal(expected.begin(), expected.end(), a.begin() + 1) || !std::equal(expected.begin(), expected.end(), b.begin() + 1) || expected != c) {
+            fprintf(stderr, "mask mismatch at size %zu\n", size);
+            return 1;
+        }
+
+        size_t stringBytes = std::min<size_t>(totalBytes, 32L << 20);
+        double stringRate = measure(size, stringBytes, [&]() { remaskString(str, key); });
+        double portableRate = measure(size, totalBytes, [&]() { Mask::applyPortable(buffer.data(), size, key); });
+        double simdRate = measure(size, totalBytes, [&]() { Mask::apply(buffer.data(), size, key); });
+        double copyRate = measure(size, totalBytes, [&]() { Mask::copy(c.data(), buffer.data(), size, key); });
+        printf("%10zu %14s %14s %14s %14s\n", size, bench::humanBytes(stringRate).c_str(), bench::humanBytes(portableRate).c_str(), bench::humanBytes(simdRate).c_str(), bench::humanBytes(copyRate).c_str());
+    }
+    return 0;
+}
@@ -0,0 +1,120 @@
+// Poll scaling benchmark: holds N idle WebSocket connections open against a
+// WSServer and measures the cost of one run() pass, the round trip of a
+// single active connection among them, and CPU use while everything is idle.
+// Runs once with the epoll reactor and once with the polling fallback.
+//
+// Usage: poll_bench [--port=8767] [--connections=5000]
+
+#include <sys/resource.h>
+
+#include "BenchUtil.h"
+#include "WSServer.h"
+
+static const char* request =
+    "GET / HTTP/1.1\r\n"
+    "Host: 127.0.0.1\r\n"
+    "Upgrade: websocket\r\n"
+    "Connection: Upgrade\r\n"
+    "Sec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\n"
+    "Sec-WebSocket-Version: 13\r\n"
+    "\r\n";
+
+// "ping" as a masked text frame with an all-zero key.
+static const uint8_t frame[] = {0x81, 0x84, 0, 0, 0, 0, 'p', 'i', 'n', 'g'};
+
+static double cpuSeconds() {
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec + (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6;
+}
+
+static int openConnection(uint16_t port) {
+    int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) return -1;
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons(port);
+    if (::connect(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0 || ::send(fd, request, strlen(request), MSG_NOSIGNAL) < 0) {
+        ::close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// Runs the server until fd has bytes to read, then drains them.
+static bool await(WSServer& server, int fd) {
+    uint8_t buf[512];
+    for (long i = 0; i < 1000000; i++) {
+        if (::recv(fd, buf, sizeof(buf), MSG_DONTWAIT) > 0) return true;
+        server.run();
+    }
+    return false;
+}
+
+static void measure(const char* name, std::shared_ptr<TCPServer> backend, uint16_t port, long connections, bool reactor) {
+    WSServer server(backend);
+    server.onConnection([](WSClient& ws) {
+        ws.onMessage([](WSClient& c, String data) {
+            c.send(data);
+        });
+    });
+    server.begin();
+
+    std::vector<int> fds;
+    for (long i = 0; i < connections; i++) {
+        int fd = openConnection(port);
+        if (fd < 0 || !await(server, fd)) {
+            fprintf(stderr, "%s: connection %ld failed\n", name, i);
+            if (fd >= 0) ::close(fd);
+            break;
+        }
+        fds.push_back(fd);
+    }
+
+    const long passes = 2000;
+    bench::Clock::time_point start = bench::Clock::now();
+    for (long i = 0; i < passes; i++) server.run();
+    double passUs = bench::microsSince(start) / passes;
+
+    std::vector<double> rtt;
+    for (int i = 0; i < 200 && !fds.empty(); i++) {
+        int fd = fds[i % fds.size()];
+        bench::Clock::time_point sentAt = bench::Clock::now();
+        ::send(fd, frame, sizeof(frame), MSG_NOSIGNAL);
+        if (!await(server, fd)) break;
+        rtt.push_back(bench::microsSince(sentAt));
+    }
+
+    // Idle loop as an application would write it: the reactor blocks in
+    // run(), the fallback polls on a 2 ms tick like the ESP32 task.
+    double cpuStart = cpuSeconds();
+    bench::Clock::time_point idleStart = bench::Clock::now();
+    while (bench::secondsSince(idleStart) < 1) {
+        if (reactor) {
+            server.run(100);
+        } else {
+            server.run();
+            delay(2);
+        }
+    }
+    double cpu = (cpuSeconds() - cpuStart) / bench::secondsSince(idleStart);
+
+    printf("%-8s %8zu %12.2f %12.1f %12.1f %10.1f%%\n", name, fds.size(), passUs, bench::percentile(rtt, 50), bench::percentile(rtt, 99), cpu * 100);
+    for (int fd : fds) ::close(fd);
+    server.end();
+}
+
+int main(int argc, char** argv) {
+    uint16_t port = bench::option(argc, argv, "port", 8767);
+    long connections = bench::option(argc, argv, "connections", 5000);
+
+    printf("%-8s %8s %12s %12s %12s %11s\n", "backend", "conns", "pass us", "rtt p50 us", "rtt p99 us", "idle cpu");
+    for (long n = 10; n <= connections; n *= 10) {
+        measure("epoll", std::make_shared<TCPEpollServer>(port, 255), port, n, true);
+        measure("poll", std::make_shared<TCPPosixServer>(port, 255), port, n, false);
+        if (n < connections && n * 10 > connections) n = connections / 10;
+    }
+    return 0;
+}
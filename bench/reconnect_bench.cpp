@@ -0,0 +1,98 @@
+// Reconnect storm benchmark: a fleet of WSClients loses its server at once,
+// the server comes back after an outage, and the clients reconnect from
+// run(). For each reconnect policy it reports how many upgrades the server
+// saw in its busiest window and how long the whole fleet took to recover.
+// "fixed" retries at a constant interval, as run() used to every 15 s.
+// Delays are scaled down from the defaults so a run takes seconds.
+//
+// Usage: reconnect_bench [--port=8767] [--clients=200] [--delay=100]
+//                        [--max-delay=3200] [--outage=1000] [--window=50]
+
+#include "BenchUtil.h"
+#include "WSServer.h"
+
+struct Result {
+    long peak;
+    double recovery;
+    long attempts;
+    long reconnected;
+};
+
+static Result storm(uint16_t port, long count, const WSClient::ReconnectPolicy& policy, long outage, long window) {
+    std::vector<double> upgrades;
+    bench::Clock::time_point dropped;
+    std::unique_ptr<WSServer> server(new WSServer(port, 255));
+    server->begin();
+
+    std::vector<std::unique_ptr<WSClient>> clients;
+    long open = 0;
+    for (long i = 0; i < count; i++) {
+        clients.emplace_back(new WSClient());
+        clients.back()->setReconnectPolicy(policy);
+        clients.back()->onOpen([&](WSClient&) { open++; });
+        clients.back()->begin("ws://127.0.0.1:" + String(port) + "/");
+    }
+    bench::Clock::time_point start = bench::Clock::now();
+    while (open < count && bench::secondsSince(start) < 10) {
+        server->run();
+        for (auto& client : clients) client->run();
+    }
+
+    // Drop every connection at once and come back after the outage.
+    open = 0;
+    long attempts = 0;
+    server.reset();
+    dropped = bench::Clock::now();
+    while (open < count && bench::secondsSince(dropped) < 60) {
+        if (!server && bench::secondsSince(dropped) * 1000 >= outage) {
+            server.reset(new WSServer(port, 255));
+            server->onConnection([&](WSClient&) { upgrades.push_back(bench::secondsSince(dropped) * 1000); });
+            server->begin();
+        }
+        if (server) server->run();
+        for (auto& client : clients) {
+            uint32_t before = client->getReconnectAttempt();
+            client->run();
+            if (client->getReconnectAttempt() > before) attempts++;
+        }
+    }
+
+    Result result = {0, bench::secondsSince(dropped) * 1000, attempts, open};
+    std::sort(upgrades.begin(), upgrades.end());
+    for (size_t i = 0, j = 0; i < upgrades.size(); i++) {
+        while (upgrades[i] - upgrades[j] >= window) j++;
+        result.peak = std::max<long>(result.peak, i - j + 1);
+    }
+    return result;
+}
+
+int main(int argc, char** argv) {
+    uint16_t port = bench::option(argc, argv, "port", 8767);
+    long count = bench::option(argc, argv, "clients", 200);
+    long outage = bench::option(argc, argv, "outage", 1000);
+    long window = bench::option(argc, argv, "window", 50);
+
+    WSClient::ReconnectPolicy base;
+    base.initialDelay = bench::option(argc, argv, "delay", 100);
+    base.maxDelay = bench::option(argc, argv, "max-delay", 3200);
+
+    struct Case {
+        const char* name;
+        WSClient::ReconnectPolicy policy;
+    } cases[4] = {{"fixed", base}, {"exponential", base}, {"full", base}, {"decorrelated", base}};
+    cases[0].policy.multiplier = 1;
+    cases[0].policy.jitter = WSClient::ReconnectPolicy::NoJitter;
+    cases[1].policy.jitter = WSClient::ReconnectPolicy::NoJitter;
+    cases[2].policy.jitter = WSClient::ReconnectPolicy::FullJitter;
+    cases[3].policy.jitter = WSClient::ReconnectPolicy::DecorrelatedJitter;
+
+    printf("%ld clients, outage %ld ms, peak upgrades per %ld ms window\n", count, outage, window);
+    printf("%-13s %8s %12s %10s %12s\n", "policy", "peak", "recovery ms", "attempts", "reconnected");
+    bool ok = true;
+    for (const Case& c : cases) {
+        Result result = storm(port, count, c.policy, outage, window);
+        printf("%-13s %8ld %12.0f %10ld %12ld\n", c.name, result.peak, result.recovery, result.attempts, result.reconnected);
+        ok = ok && result.reconnected == count;
+    }
+    return ok ? 0 : 1;
+}
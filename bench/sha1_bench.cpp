@@ -0,0 +1,58 @@
+// SHA-1 benchmark: accept keys per second the way generateHandshakeKey()
+// used to compute them (String key, streamed adds) against the one-shot
+// Crypto::acceptKey(), then raw hashing throughput of the portable code
+// against the backend chosen for this host.
+//
+// Usage: sha1_bench [--rounds=1000000] [--bytes=67108864]
+
+#include "BenchUtil.h"
+#include "utilities/Crypto.h"
+
+template <typename Fn>
+static double rate(long rounds, Fn fn) {
+    bench::Clock::time_point start = bench::Clock::now();
+    for (long r = 0; r < rounds; r++) fn();
+    return rounds / bench::secondsSince(start);
+}
+
+int main(int argc, char** argv) {
+    long rounds = bench::option(argc, argv, "rounds", 1000000);
+    size_t totalBytes = bench::option(argc, argv, "bytes", 64L << 20);
+    const char* key = "dGhlIHNhbXBsZSBub25jZQ==";
+    const char* expected = "s3pPLMBiTxaQ9kYGzzhZRbK+xOo=";
+    String keyString(key);
+
+    char out[SHA1_BASE64_SIZE];
+    Crypto::acceptKey(key, strlen(key), out);
+    if (strcmp(out, expected) || !Crypto::generateHandshakeKey(keyString).equals(expected)) {
+        fprintf(stderr, "accept key mismatch\n");
+        return 1;
+    }
+
+    printf("backend: %s\n", SHA1::backend());
+    double streamed = rate(rounds, [&]() {
+        char base64[SHA1_BASE64_SIZE];
+        SHA1(keyString).add("258EAFA5-E914-47DA-95CA-C5AB0DC85B11").finalize().getBase64(base64);
+    });
+    double oneShot = rate(rounds, [&]() { Crypto::acceptKey(key, 24, out); });
+    printf("accept keys/s  streamed %.0f, one-shot %.0f (%.2fx)\n", streamed, oneShot, oneShot / streamed);
+
+    printf("%10s %14s %14s %8s\n", "size", "portable/s", "backend/s", "speedup");
+    const size_t sizes[] = {64, 1024, 16384, 1048576};
+    for (size_t size : sizes) {
+        std::vector<uint8_t> data(size);
+        for (size_t i = 0; i < size; i++) data[i] = i * 31;
+        char a[SHA1_HEX_SIZE], b[SHA1_HEX_SIZE];
+        SHA1::digestPortable(data.data(), size).getHex(a);
+        SHA1::digest(data.data(), size).getHex(b);
+        if (strcmp(a, b)) {
+            fprintf(stderr, "digest mismatch at size %zu\n", size);
+            return 1;
+        }
+        long count = std::max<long>(1, totalBytes / size);
+        double portable = rate(count, [&]() { SHA1::digestPortable(data.data(), size); }) * size;
+        double backend = rate(count, [&]() { SHA1::digest(data.data(), size); }) * size;
+        printf("%10zu %14s %14s %7.2fx\n", size, bench::humanBytes(portable).c_str(), bench::humanBytes(backend).c_str(), backend / portable);
+    }
+    return 0;
+}
@@ -0,0 +1,105 @@
+// Worker scaling benchmark: several client threads echo messages through a
+// WSServer running with 1, 2, 4... worker event loops, then the server
+// broadcasts to all of them across shards.
+//
+// Usage: shard_bench [--port=8768] [--workers=4] [--clients=8] [--seconds=2] [--size=128]
+
+#include <atomic>
+#include <thread>
+
+#include "BenchUtil.h"
+#include "WSClient.h"
+#include "WSServer.h"
+
+struct Result {
+    double messagesPerSecond;
+    long broadcastsReceived;
+    long connected;
+};
+
+static Result measure(uint16_t port, int workers, int clients, double seconds, long size) {
+    WSServer server(port, 255);
+    server.setWorkers(workers);
+    server.onConnection([](WSClient& ws) {
+        ws.onMessage([](WSClient& c, String data) {
+            c.send(data);
+        });
+    });
+    server.begin();
+    std::atomic<bool> stop(false);
+
+    std::string text(size, 'x');
+    String payload(text.c_str());
+    std::atomic<long> messages(0);
+    std::atomic<long> broadcasts(0);
+    std::atomic<long> connected(0);
+    std::atomic<bool> measuring(false);
+    std::vector<std::thread> threads;
+    for (int i = 0; i < clients; i++) {
+        threads.push_back(std::thread([&]() {
+            WSClient client;
+            bool received = false;
+            client.onMessage([&](WSClient&, String data) {
+                if (data == "broadcast") {
+                    broadcasts++;
+                } else {
+                    received = true;
+                }
+            });
+            String url = "ws://127.0.0.1:" + String(port) + "/";
+            if (!client.begin(url, true)) return;
+            connected++;
+            while (!measuring && !stop) delay(1);
+            long count = 0;
+            while (measuring) {
+                received = false;
+                client.send(payload);
+                while (!received && client.isConnected()) {
+                    client.poll();
+                    yield();
+                }
+                count++;
+            }
+            messages += count;
+            while (!stop) {
+                client.poll();
+                yield();
+            }
+        }));
+    }
+
+    bench::Clock::time_point connecting = bench::Clock::now();
+    while (connected < clients && bench::secondsSince(connecting) < 5) delay(1);
+    measuring = true;
+    bench::Clock::time_point start = bench::Clock::now();
+    delay(seconds * 1000);
+    measuring = false;
+    double elapsed = bench::secondsSince(start);
+    delay(100);
+
+    server.broadcast("broadcast");
+    bench::Clock::time_point sent = bench::Clock::now();
+    while (broadcasts < connected && bench::secondsSince(sent) < 2) delay(1);
+
+    stop = true;
+    for (auto& thread : threads) thread.join();
+    server.end();
+    Result result = {messages / elapsed, broadcasts, connected};
+    return result;
+}
+
+int main(int argc, char** argv) {
+    uint16_t port = bench::option(argc, argv, "port", 8768);
+    long workers = bench::option(argc, argv, "workers", 4);
+    long clients = bench::option(argc, argv, "clients", 8);
+    long seconds = bench::option(argc, argv, "seconds", 2);
+    long size = bench::option(argc, argv, "size", 128);
+
+    printf("cores: %u\n", std::thread::hardware_concurrency());
+    printf("%-8s %8s %14s %12s\n", "workers", "clients", "msgs/sec", "broadcast");
+    for (long w = 1; w <= workers; w *= 2) {
+        Result result = measure(port + w, w, clients, seconds, size);
+        printf("%-8ld %8ld %14.0f %8ld/%ld\n", w, result.connected, result.messagesPerSecond, result.broadcastsReceived, result.connected);
+    }
+    return 0;
+}
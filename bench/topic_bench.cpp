@@ -0,0 +1,116 @@
+// Publish/subscribe benchmark: holds N raw WebSocket connections spread
+// over 200 topics, with a fixed number of them subscribed to one hot topic,
+// and measures publish() to that topic as N grows. For comparison, the same
+// recipients are reached with a filtered broadcast(), which has to look at
+// every connection.
+//
+// Usage: topic_bench [--port=8771] [--connections=5000] [--subscribers=10] [--size=64] [--rounds=500]
+
+#include <unordered_set>
+
+#include "BenchUtil.h"
+#include "WSServer.h"
+
+static const char* request =
+    "GET / HTTP/1.1\r\n"
+    "Host: 127.0.0.1\r\n"
+    "Upgrade: websocket\r\n"
+    "Connection: Upgrade\r\n"
+    "Sec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\n"
+    "Sec-WebSocket-Version: 13\r\n"
+    "\r\n";
+
+static int openConnection(uint16_t port) {
+    int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) return -1;
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons(port);
+    if (::connect(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0 || ::send(fd, request, strlen(request), MSG_NOSIGNAL) < 0) {
+        ::close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// Runs the server until fd has bytes to read, then drains them.
+static bool await(WSServer& server, int fd) {
+    uint8_t buf[512];
+    for (long i = 0; i < 1000000; i++) {
+        if (::recv(fd, buf, sizeof(buf), MSG_DONTWAIT) > 0) return true;
+        server.run();
+    }
+    return false;
+}
+
+// Reads whatever the server sent to the hot topic's subscribers.
+static void drain(const std::vector<int>& fds, long count) {
+    static uint8_t buf[65536];
+    for (long i = 0; i < count && i < (long)fds.size(); i++) {
+        while (::recv(fds[i], buf, sizeof(buf), MSG_DONTWAIT) > 0) {
+        }
+    }
+}
+
+int main(int argc, char** argv) {
+    uint16_t port = bench::option(argc, argv, "port", 8771);
+    long connections = bench::option(argc, argv, "connections", 5000);
+    long subscribers = bench::option(argc, argv, "subscribers", 10);
+    long size = bench::option(argc, argv, "size", 64);
+    long rounds = bench::option(argc, argv, "rounds", 500);
+
+    std::string text(size, 'x');
+    String payload(text.c_str());
+
+    // The first connections join the hot topic, the rest spread over 199
+    // others, so the hot topic's audience stays the same as N grows.
+    WSServer server(port, 255);
+    std::unordered_set<WSClient::Handle> hot;
+    long joined = 0;
+    server.onConnection([&](WSClient& ws) {
+        if (joined < subscribers) {
+            server.subscribe(ws.handle, "sensor/0");
+            hot.insert(ws.handle);
+        } else {
+            server.subscribe(ws.handle, "sensor/" + String(1 + joined % 199));
+        }
+        joined++;
+    });
+    server.begin();
+    std::vector<int> fds;
+
+    printf("%-8s %12s %14s %14s\n", "conns", "subscribers", "publish us", "filtered us");
+    for (long n = 10; n <= connections; n *= 10) {
+        while ((long)fds.size() < n) {
+            int fd = openConnection(port);
+            if (fd < 0 || !await(server, fd)) {
+                fprintf(stderr, "connection %zu failed\n", fds.size());
+                if (fd >= 0) ::close(fd);
+                break;
+            }
+            fds.push_back(fd);
+        }
+
+        double publish = 0;
+        double filtered = 0;
+        for (long r = 0; r < rounds; r++) {
+            bench::Clock::time_point start = bench::Clock::now();
+            server.publish("sensor/0", payload);
+            publish += bench::microsSince(start);
+            drain(fds, subscribers);
+
+            start = bench::Clock::now();
+            server.broadcast(payload, [&](WSClient& c) { return hot.count(c.handle) > 0; });
+            filtered += bench::microsSince(start);
+            drain(fds, subscribers);
+        }
+        printf("%-8zu %12zu %14.2f %14.2f\n", fds.size(), hot.size(), publish / rounds, filtered / rounds);
+        if (n < connections && n * 10 > connections) n = connections / 10;
+    }
+
+    for (int fd : fds) ::close(fd);
+    server.end();
+    return 0;
+}
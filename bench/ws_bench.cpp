@@ -0,0 +1,107 @@
+// Round-trip benchmark: a WSClient sends text messages to a WSServer over
+// loopback and waits for each echo before sending the next one.
+//
+// Usage: ws_bench [--port=8765] [--messages=10000] [--size=128] [--binary=0]
+
+#include <atomic>
+#include <thread>
+
+#include "BenchUtil.h"
+#include "WSClient.h"
+#include "WSServer.h"
+
+int main(int argc, char** argv) {
+    uint16_t port = bench::option(argc, argv, "port", 8765);
+    long messages = bench::option(argc, argv, "messages", 10000);
+    long size = bench::option(argc, argv, "size", 128);
+    bool binary = bench::option(argc, argv, "binary", 0);
+    if (size < 1) {
+        fprintf(stderr, "size must be positive\n");
+        return 1;
+    }
+
+    std::atomic<bool> stop(false);
+    WSServer server(port, 16);
+    server.onConnection([&](WSClient& ws) {
+        ws.setMaxMessageSize(size);
+        ws.onMessage([](WSClient& c, String data) {
+            c.send(data);
+        });
+        ws.onBinary([](WSClient& c, const uint8_t* data, size_t len) {
+            c.sendBinary(data, len);
+        });
+    });
+    server.begin();
+    std::thread serverThread([&]() {
+        while (!stop) {
+            server.run();
+            yield();
+        }
+    });
+
+    WSClient client;
+    client.setMaxMessageSize(size);
+    bool received = false;
+    client.onMessage([&](WSClient&, String) {
+        received = true;
+    });
+    client.onBinary([&](WSClient&, const uint8_t*, size_t) {
+        received = true;
+    });
+
+    String url = "ws://127.0.0.1:" + String(port) + "/";
+    bool connected = false;
+    for (int attempt = 0; attempt < 5 && !connected; attempt++) {
+        if (attempt) delay(500);
+        connected = client.begin(url, true);
+    }
+    if (!connected) {
+        fprintf(stderr, "cannot connect to %s\n", url.c_str());
+        stop = true;
+        serverThread.join();
+        return 1;
+    }
+
+    std::string text(size, 0);
+    for (long i = 0; i < size; i++) text[i] = 'a' + i % 26;
+    String payload(text.c_str());
+
+    std::vector<double> rtt;
+    rtt.reserve(messages);
+    bench::Clock::time_point start = bench::Clock::now();
+    for (long i = 0; i < messages; i++) {
+        received = false;
+        bench::Clock::time_point sentAt = bench::Clock::now();
+        bool sent = binary ? client.sendBinary((const uint8_t*)text.data(), size) : client.send(payload);
+        if (!sent) {
+            fprintf(stderr, "send failed after %ld messages\n", i);
+            break;
+        }
+        while (!received && client.isConnected()) {
+            client.poll();
+            if (!received) {
+                if (bench::secondsSince(sentAt) > 5) break;
+                yield();
+            }
+        }
+        if (!received) {
+            fprintf(stderr, "no echo after %ld messages\n", i);
+            break;
+        }
+        rtt.push_back(bench::microsSince(sentAt));
+    }
+    double elapsed = bench::secondsSince(start);
+
+    client.close(CloseReason_NormalClosure);
+    stop = true;
+    serverThread.join();
+
+    double count = rtt.size();
+    printf("messages:     %.0f x %ld bytes\n", count, size);
+    printf("elapsed:      %.3f s\n", elapsed);
+    printf("messages/sec: %.0f\n", count / elapsed);
+    printf("bytes/sec:    %s (payload, both directions)\n", bench::humanBytes(2 * count * size / elapsed).c_str());
+    printf("rtt p50:      %.1f us\n", bench::percentile(rtt, 50));
+    printf("rtt p99:      %.1f us\n", bench::percentile(rtt, 99));
+    return count == messages ? 0 : 1;
+}
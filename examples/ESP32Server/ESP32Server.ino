@@ -40,8 +40,6 @@ void setup() {
 void loop() {
     if (Serial.available()) {
         String data = Serial.readString();
-        for (auto& c : server.getClients()) {
-            c.send(data);
-        }
+        server.broadcast(data);
     }
 }
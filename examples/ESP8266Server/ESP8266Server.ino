@@ -45,8 +45,6 @@ void loop() {
 
     if (Serial.available()) {
         String data = Serial.readString();
-        for (auto& c : server.getClients()) {
-            c.send(data);
-        }
+        server.broadcast(data);
     }
 }
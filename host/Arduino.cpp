@@ -0,0 +1,42 @@
+#include "Arduino.h"
+
+#include <chrono>
+#include <random>
+#include <thread>
+
+static const std::chrono::steady_clock::time_point startTime = std::chrono::steady_clock::now();
+
+static std::mt19937& randomEngine() {
+    static thread_local std::mt19937 engine(std::random_device{}());
+    return engine;
+}
+
+uint32_t millis() {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - startTime).count();
+}
+
+uint32_t micros() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - startTime).count();
+}
+
+void delay(uint32_t ms) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+}
+
+void yield() {
+    std::this_thread::yield();
+}
+
+long random(long max) {
+    if (max <= 0) return 0;
+    return random(0, max);
+}
+
+long random(long min, long max) {
+    if (min >= max) return min;
+    return std::uniform_int_distribution<long>(min, max - 1)(randomEngine());
+}
+
+void randomSeed(unsigned long seed) {
+    randomEngine().seed(seed);
+}
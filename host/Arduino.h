@@ -0,0 +1,30 @@
+#ifndef HOST_ARDUINO_H
+#define HOST_ARDUINO_H
+
+// Minimal Arduino core replacement used by the host (Linux/macOS) build.
+// Only what the library itself needs is provided here.
+
+#include <ctype.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <functional>
+#include <memory>
+#include <vector>
+
+#include "WString.h"
+
+#define DEC 10
+#define HEX 16
+
+uint32_t millis();
+uint32_t micros();
+void delay(uint32_t ms);
+void yield();
+long random(long max);
+long random(long min, long max);
+void randomSeed(unsigned long seed);
+
+#endif
@@ -0,0 +1,34 @@
+#ifndef HOST_IP_ADDRESS_H
+#define HOST_IP_ADDRESS_H
+
+#include "Arduino.h"
+
+class IPAddress {
+   public:
+    IPAddress() : address{0, 0, 0, 0} {}
+    IPAddress(uint8_t a, uint8_t b, uint8_t c, uint8_t d) : address{a, b, c, d} {}
+    explicit IPAddress(const uint8_t* bytes) {
+        memcpy(address, bytes, 4);
+    }
+
+    uint8_t operator[](int index) const {
+        return address[index];
+    }
+
+    bool operator==(const IPAddress& other) const {
+        return memcmp(address, other.address, 4) == 0;
+    }
+
+    bool operator!=(const IPAddress& other) const {
+        return !(*this == other);
+    }
+
+    String toString() const {
+        return String(address[0]) + "." + String(address[1]) + "." + String(address[2]) + "." + String(address[3]);
+    }
+
+   private:
+    uint8_t address[4];
+};
+
+#endif
@@ -0,0 +1,187 @@
+#include "WString.h"
+
+#include <ctype.h>
+#include <stdlib.h>
+
+static std::string toBase(unsigned long long value, unsigned char base, bool negative) {
+    if (base < 2 || base > 36) base = 10;
+    std::string digits;
+    do {
+        unsigned char d = value % base;
+        digits.insert(digits.begin(), d < 10 ? '0' + d : 'a' + d - 10);
+        value /= base;
+    } while (value);
+    if (negative) digits.insert(digits.begin(), '-');
+    return digits;
+}
+
+static std::string toBase(long long value, unsigned char base) {
+    if (base == 10 && value < 0) return toBase(0ULL - (unsigned long long)value, base, true);
+    return toBase((unsigned long long)value, base, false);
+}
+
+String::String(const char* cstr) : buffer(cstr ? cstr : "") {}
+String::String(const char* cstr, size_t len) : buffer(cstr, len) {}
+String::String(const std::string& str) : buffer(str) {}
+String::String(char c) : buffer(1, c) {}
+String::String(unsigned char value, unsigned char base) : buffer(toBase((unsigned long long)value, base, false)) {}
+String::String(int value, unsigned char base) : buffer(toBase((long long)value, base)) {}
+String::String(unsigned int value, unsigned char base) : buffer(toBase((unsigned long long)value, base, false)) {}
+String::String(long value, unsigned char base) : buffer(toBase((long long)value, base)) {}
+String::String(unsigned long value, unsigned char base) : buffer(toBase((unsigned long long)value, base, false)) {}
+String::String(long long value, unsigned char base) : buffer(toBase(value, base)) {}
+String::String(unsigned long long value, unsigned char base) : buffer(toBase(value, base, false)) {}
+
+bool String::reserve(unsigned int size) {
+    buffer.reserve(size);
+    return true;
+}
+
+String& String::operator+=(const String& rhs) {
+    buffer += rhs.buffer;
+    return *this;
+}
+
+String& String::operator+=(const char* rhs) {
+    if (rhs) buffer += rhs;
+    return *this;
+}
+
+String& String::operator+=(char c) {
+    buffer += c;
+    return *this;
+}
+
+bool String::concat(const String& str) {
+    buffer += str.buffer;
+    return true;
+}
+
+bool String::concat(const char* cstr, unsigned int len) {
+    if (!cstr) return false;
+    buffer.append(cstr, len);
+    return true;
+}
+
+bool String::concat(char c) {
+    buffer += c;
+    return true;
+}
+
+bool String::equalsIgnoreCase(const String& str) const {
+    if (buffer.length() != str.buffer.length()) return false;
+    for (size_t i = 0; i < buffer.length(); i++) {
+        if (tolower((unsigned char)buffer[i]) != tolower((unsigned char)str.buffer[i])) return false;
+    }
+    return true;
+}
+
+bool String::startsWith(const String& prefix) const {
+    return buffer.compare(0, prefix.buffer.length(), prefix.buffer) == 0;
+}
+
+bool String::endsWith(const String& suffix) const {
+    if (suffix.buffer.length() > buffer.length()) return false;
+    return buffer.compare(buffer.length() - suffix.buffer.length(), suffix.buffer.length(), suffix.buffer) == 0;
+}
+
+char String::charAt(unsigned int index) const {
+    return index < buffer.length() ? buffer[index] : 0;
+}
+
+void String::setCharAt(unsigned int index, char c) {
+    if (index < buffer.length()) buffer[index] = c;
+}
+
+char String::operator[](unsigned int index) const {
+    return charAt(index);
+}
+
+char& String::operator[](unsigned int index) {
+    static char dummy;
+    if (index >= buffer.length()) {
+        dummy = 0;
+        return dummy;
+    }
+    return buffer[index];
+}
+
+int String::indexOf(char ch, unsigned int fromIndex) const {
+    size_t pos = buffer.find(ch, fromIndex);
+    return pos == std::string::npos ? -1 : (int)pos;
+}
+
+int String::indexOf(const String& str, unsigned int fromIndex) const {
+    size_t pos = buffer.find(str.buffer, fromIndex);
+    return pos == std::string::npos ? -1 : (int)pos;
+}
+
+int String::lastIndexOf(char ch) const {
+    size_t pos = buffer.rfind(ch);
+    return pos == std::string::npos ? -1 : (int)pos;
+}
+
+String String::substring(unsigned int beginIndex) const {
+    if (beginIndex >= buffer.length()) return String();
+    return String(buffer.substr(beginIndex));
+}
+
+String String::substring(unsigned int beginIndex, unsigned int endIndex) const {
+    if (beginIndex > endIndex) std::swap(beginIndex, endIndex);
+    if (beginIndex >= buffer.length()) return String();
+    return String(buffer.substr(beginIndex, endIndex - beginIndex));
+}
+
+void String::replace(const String& find, const String& replace) {
+    if (find.buffer.empty()) return;
+    size_t pos = 0;
+    while ((pos = buffer.find(find.buffer, pos)) != std::string::npos) {
+        buffer.replace(pos, find.buffer.length(), replace.buffer);
+        pos += replace.buffer.length();
+    }
+}
+
+void String::remove(unsigned int index, unsigned int count) {
+    if (index >= buffer.length()) return;
+    buffer.erase(index, count);
+}
+
+void String::toLowerCase() {
+    for (auto& c : buffer) c = tolower((unsigned char)c);
+}
+
+void String::toUpperCase() {
+    for (auto& c : buffer) c = toupper((unsigned char)c);
+}
+
+void String::trim() {
+    size_t begin = 0;
+    size_t end = buffer.length();
+    while (begin < end && isspace((unsigned char)buffer[begin])) begin++;
+    while (end > begin && isspace((unsigned char)buffer[end - 1])) end--;
+    buffer = buffer.substr(begin, end - begin);
+}
+
+long String::toInt() const {
+    return strtol(buffer.c_str(), NULL, 10);
+}
+
+String operator+(const String& lhs, const String& rhs) {
+    return String(lhs.buffer + rhs.buffer);
+}
+
+String operator+(const String& lhs, const char* rhs) {
+    return String(lhs.buffer + (rhs ? rhs : ""));
+}
+
+String operator+(const char* lhs, const String& rhs) {
+    return String((lhs ? lhs : "") + rhs.buffer);
+}
+
+String operator+(const String& lhs, char rhs) {
+    return String(lhs.buffer + rhs);
+}
+
+String operator+(char lhs, const String& rhs) {
+    return String(lhs + rhs.buffer);
+}
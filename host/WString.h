@@ -0,0 +1,75 @@
+#ifndef HOST_WSTRING_H
+#define HOST_WSTRING_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <string>
+
+// Subset of the Arduino String class backed by std::string.
+class String {
+   public:
+    String(const char* cstr = "");
+    String(const char* cstr, size_t len);
+    String(const std::string& str);
+    explicit String(char c);
+    explicit String(unsigned char value, unsigned char base = 10);
+    explicit String(int value, unsigned char base = 10);
+    explicit String(unsigned int value, unsigned char base = 10);
+    explicit String(long value, unsigned char base = 10);
+    explicit String(unsigned long value, unsigned char base = 10);
+    explicit String(long long value, unsigned char base = 10);
+    explicit String(unsigned long long value, unsigned char base = 10);
+
+    unsigned int length() const { return buffer.length(); }
+    bool isEmpty() const { return buffer.empty(); }
+    const char* c_str() const { return buffer.c_str(); }
+    bool reserve(unsigned int size);
+
+    String& operator+=(const String& rhs);
+    String& operator+=(const char* rhs);
+    String& operator+=(char c);
+    bool concat(const String& str);
+    bool concat(const char* cstr, unsigned int len);
+    bool concat(char c);
+
+    bool equals(const String& str) const { return buffer == str.buffer; }
+    bool equals(const char* cstr) const { return buffer == (cstr ? cstr : ""); }
+    bool equalsIgnoreCase(const String& str) const;
+    bool operator==(const String& rhs) const { return equals(rhs); }
+    bool operator==(const char* rhs) const { return equals(rhs); }
+    bool operator!=(const String& rhs) const { return !equals(rhs); }
+    bool operator!=(const char* rhs) const { return !equals(rhs); }
+    bool operator<(const String& rhs) const { return buffer < rhs.buffer; }
+    bool startsWith(const String& prefix) const;
+    bool endsWith(const String& suffix) const;
+
+    char charAt(unsigned int index) const;
+    void setCharAt(unsigned int index, char c);
+    char operator[](unsigned int index) const;
+    char& operator[](unsigned int index);
+
+    int indexOf(char ch, unsigned int fromIndex = 0) const;
+    int indexOf(const String& str, unsigned int fromIndex = 0) const;
+    int lastIndexOf(char ch) const;
+    String substring(unsigned int beginIndex) const;
+    String substring(unsigned int beginIndex, unsigned int endIndex) const;
+
+    void replace(const String& find, const String& replace);
+    void remove(unsigned int index, unsigned int count = (unsigned int)-1);
+    void toLowerCase();
+    void toUpperCase();
+    void trim();
+    long toInt() const;
+
+    friend String operator+(const String& lhs, const String& rhs);
+    friend String operator+(const String& lhs, const char* rhs);
+    friend String operator+(const char* lhs, const String& rhs);
+    friend String operator+(const String& lhs, char rhs);
+    friend String operator+(char lhs, const String& rhs);
+
+   private:
+    std::string buffer;
+};
+
+#endif
@@ -3,7 +3,15 @@
 
 #include "Arduino.h"
 #include "IPAddress.h"
-#include "utilities/Crypto.h"
+
+#ifndef TCP_COALESCE_SIZE
+#define TCP_COALESCE_SIZE 256
+#endif
+
+struct TCPBuffer {
+    const uint8_t* data;
+    size_t len;
+};
 
 class TCPClient {
    public:
@@ -11,82 +19,80 @@ class TCPClient {
     virtual int read(uint8_t* buffer, size_t len) = 0;
     virtual int available() = 0;
     virtual int connected() = 0;
+    // Whether the connection is still open as far as the backend knows,
+    // without asking the network stack if that costs a call. Backends that
+    // learn about closes from failed reads and writes, or from a poller,
+    // override this with a cheaper check than connected().
+    virtual bool isOpen() {
+        return connected();
+    }
     virtual IPAddress remoteIP() = 0;
     virtual uint16_t remotePort() = 0;
 
+    enum ConnectStatus {
+        ConnectPending,
+        ConnectDone,
+        ConnectFailed
+    };
+
+    // Non-blocking connect: startConnect() sets the connection going and
+    // connectStatus() tells how far it got. The defaults connect in one
+    // blocking call, for backends that have no other way; those that can
+    // should give up after timeout ms.
+    virtual bool startConnect(const String& host, uint16_t port, uint32_t) {
+        return connect(host, port, "", std::vector<std::pair<String, String>>());
+    }
+    virtual ConnectStatus connectStatus() {
+        return connected() ? ConnectDone : ConnectFailed;
+    }
+
    protected:
     virtual bool connect(const String& host, const uint16_t& port, const String& path, std::vector<std::pair<String, String>> customHeaders) = 0;
     virtual void disconnect() = 0;
 
    public:
-    bool begin(const String& host, const uint16_t& port, const String& path, std::vector<std::pair<String, String>> customHeaders) {
-        if (!connect(host, port, path, customHeaders)) return false;
-        Crypto::HandshakeRequestResult handshake = Crypto::generateHandshake(host, path, customHeaders);
-
-        write(handshake.requestStr);
-        if (!connected()) return false;
-        String header = readLine();
-
-        if (!header.startsWith("HTTP/1.1 101")) {
-            disconnect();
-            return false;
-        }
+    void end() {
+        disconnect();
+    }
 
-        std::vector<String> serverResponseHeaders;
-        String line;
-        while (available()) {
-            line = readLine();
-            line.trim();
-            serverResponseHeaders.push_back(line);
-            if (!line.length()) break;
+    // Gather write. Backends with a native scatter-gather call should
+    // override this; the default coalesces small writes into one segment
+    // and otherwise writes each buffer in turn.
+    virtual size_t write(const TCPBuffer* buffers, size_t count) {
+        size_t total = 0;
+        for (size_t i = 0; i < count; i++) total += buffers[i].len;
+        if (total <= TCP_COALESCE_SIZE) {
+            uint8_t data[TCP_COALESCE_SIZE];
+            size_t offset = 0;
+            for (size_t i = 0; i < count; i++) {
+                if (buffers[i].len) memcpy(data + offset, buffers[i].data, buffers[i].len);
+                offset += buffers[i].len;
+            }
+            return write(data, total);
         }
-
-        Crypto::HandshakeResponseResult parsedResponse = Crypto::parseHandshakeResponse(serverResponseHeaders);
-        bool serverAcceptMismatch = !parsedResponse.serverAccept.equals(handshake.expectedAcceptKey);
-        if (parsedResponse.isSuccess == false || serverAcceptMismatch) {
-            disconnect();
-            return false;
+        size_t written = 0;
+        for (size_t i = 0; i < count; i++) {
+            size_t res = write((uint8_t*)buffers[i].data, buffers[i].len);
+            written += res;
+            if (res < buffers[i].len) break;
         }
-        return true;
+        return written;
     }
 
-    void end() {
-        disconnect();
+    // Writes as much as the connection takes without blocking and returns
+    // how much that was, or -1 once the connection is gone. Backends that
+    // cannot tell how much room there is fall back to the blocking write().
+    virtual int writeSome(const TCPBuffer* buffers, size_t count) {
+        size_t total = 0;
+        for (size_t i = 0; i < count; i++) total += buffers[i].len;
+        size_t res = write(buffers, count);
+        if (res < total && !connected()) return -1;
+        return res;
     }
 
     size_t write(const String& data) {
         return write((uint8_t*)data.c_str(), data.length());
     }
-
-    int read() {
-        uint32_t lastMillis = millis();
-        do {
-            uint8_t data = 0;
-            if (read(&data, 1) > 0) return data;
-        } while (millis() - lastMillis < 1000);
-        return -1;
-    }
-
-    String readString() {
-        String ret;
-        int c = read();
-        while (c >= 0) {
-            ret += (char)c;
-            c = read();
-        }
-        return ret;
-    }
-
-    String readLine() {
-        String ret;
-        int c = read();
-        while (c >= 0 && c != '\n') {
-            ret += (char)c;
-            c = read();
-        }
-        ret.trim();
-        return ret;
-    }
 };
 
 #endif
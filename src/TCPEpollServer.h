@@ -0,0 +1,105 @@
+#ifndef TCP_EPOLL_SERVER_H
+#define TCP_EPOLL_SERVER_H
+
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+
+#include "TCPPosixServer.h"
+
+// Edge-triggered epoll set. An eventfd is registered alongside the sockets
+// so other threads can interrupt wait().
+class TCPEpollPoller : public TCPPoller {
+   public:
+    TCPEpollPoller(int listenFd)
+        : epfd(epoll_create1(EPOLL_CLOEXEC)), wakeFd(eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) {
+        if (listenFd >= 0) add(listenFd, EPOLLIN | EPOLLET, &listenMarker);
+        if (wakeFd >= 0) add(wakeFd, EPOLLIN | EPOLLET, &wakeMarker);
+    }
+
+    ~TCPEpollPoller() {
+        if (epfd >= 0) ::close(epfd);
+        if (wakeFd >= 0) ::close(wakeFd);
+    }
+
+    TCPEpollPoller(const TCPEpollPoller &) = delete;
+    TCPEpollPoller &operator=(const TCPEpollPoller &) = delete;
+
+    bool valid() const {
+        return epfd >= 0 && wakeFd >= 0;
+    }
+
+    bool watch(TCPClient *client) override {
+        int sock = static_cast<TCPPosixClient *>(client)->getFd();
+        // EPOLLOUT is edge-triggered too, so it only fires once a socket
+        // that filled up has room again; see WSClient::flush().
+        return sock >= 0 && add(sock, EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET, client);
+    }
+
+    void unwatch(TCPClient *client) override {
+        int sock = static_cast<TCPPosixClient *>(client)->getFd();
+        // Closing a socket removes it from the epoll set, so a client that
+        // already disconnected needs nothing here.
+        if (epfd >= 0 && sock >= 0) epoll_ctl(epfd, EPOLL_CTL_DEL, sock, NULL);
+    }
+
+    int wait(TCPClient **ready, int max, uint32_t timeout, bool &acceptable) override {
+        acceptable = false;
+        if (epfd < 0 || max <= 0) return 0;
+        struct epoll_event events[64];
+        int n;
+        do {
+            n = epoll_wait(epfd, events, std::min(max, 64), timeout);
+        } while (n < 0 && errno == EINTR);
+        int count = 0;
+        for (int i = 0; i < n; i++) {
+            void *ptr = events[i].data.ptr;
+            if (ptr == &listenMarker) {
+                acceptable = true;
+            } else if (ptr == &wakeMarker) {
+                uint64_t value;
+                while (::read(wakeFd, &value, sizeof(value)) > 0) {
+                }
+            } else {
+                if (events[i].events & (EPOLLRDHUP | EPOLLHUP | EPOLLERR)) static_cast<TCPPosixClient *>(ptr)->markHangup();
+                ready[count++] = (TCPClient *)ptr;
+            }
+        }
+        return count;
+    }
+
+    void wake() override {
+        uint64_t value = 1;
+        if (wakeFd >= 0) ::write(wakeFd, &value, sizeof(value));
+    }
+
+   private:
+    int epfd;
+    int wakeFd;
+    char listenMarker;
+    char wakeMarker;
+
+    bool add(int fd, uint32_t events, void *ptr) {
+        struct epoll_event ev;
+        memset(&ev, 0, sizeof(ev));
+        ev.events = events;
+        ev.data.ptr = ptr;
+        return epfd >= 0 && epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev) == 0;
+    }
+};
+
+// TCPPosixServer with epoll readiness, so a server with thousands of idle
+// connections only touches the ones that have data. Linux only.
+class TCPEpollServer : public TCPPosixServer {
+   public:
+    TCPEpollServer(uint16_t port, uint8_t maxClients = 4)
+        : TCPPosixServer(port, maxClients) {}
+
+    std::shared_ptr<TCPPoller> createPoller(bool listen) override {
+        if (fd < 0) return nullptr;
+        std::shared_ptr<TCPEpollPoller> poller = std::make_shared<TCPEpollPoller>(listen ? fd : -1);
+        if (!poller->valid()) return nullptr;
+        return poller;
+    }
+};
+
+#endif
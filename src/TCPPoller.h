@@ -0,0 +1,25 @@
+#ifndef TCP_POLLER_H
+#define TCP_POLLER_H
+
+#include "Arduino.h"
+#include "TCPClient.h"
+
+// Readiness notification for backends that can wait on many sockets at
+// once. Each WSServer worker owns one. watch() registers a client returned
+// by TCPServer::accept(), and wait() blocks for up to timeout ms, then fills
+// ready with watched clients that have data or were closed. On the poller
+// created for the listen socket, it also sets acceptable when connections
+// are pending. Notification is edge-triggered: a client is reported again
+// only after more data arrives, so callers must keep track of clients they
+// did not drain. wake() makes a blocked wait() return early and may be
+// called from any thread.
+class TCPPoller {
+   public:
+    virtual ~TCPPoller() {}
+    virtual bool watch(TCPClient* client) = 0;
+    virtual void unwatch(TCPClient* client) = 0;
+    virtual int wait(TCPClient** ready, int max, uint32_t timeout, bool& acceptable) = 0;
+    virtual void wake() = 0;
+};
+
+#endif
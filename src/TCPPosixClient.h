@@ -0,0 +1,269 @@
+#ifndef TCP_POSIX_CLIENT_H
+#define TCP_POSIX_CLIENT_H
+
+#include "TCPClient.h"
+#if defined(__unix__) || defined(__APPLE__)
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#else
+#error "Unsupported platform. TCPPosixClient requires BSD sockets."
+#endif
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+class TCPPosixClient : public TCPClient {
+   public:
+    TCPPosixClient() : fd(-1), port(0) {}
+    TCPPosixClient(int fd) : fd(fd), port(0) {
+        setup();
+    }
+
+    ~TCPPosixClient() {
+        disconnect();
+    }
+
+    TCPPosixClient(const TCPPosixClient &) = delete;
+    TCPPosixClient &operator=(const TCPPosixClient &) = delete;
+
+    bool connect(const String &host, const uint16_t &port, const String &, std::vector<std::pair<String, String>>) override {
+        disconnect();
+        struct addrinfo hints;
+        memset(&hints, 0, sizeof(hints));
+        hints.ai_family = AF_INET;
+        hints.ai_socktype = SOCK_STREAM;
+        struct addrinfo *result = NULL;
+        if (getaddrinfo(host.c_str(), String(port).c_str(), &hints, &result) != 0) return false;
+        for (struct addrinfo *ai = result; ai; ai = ai->ai_next) {
+            int sock = ::socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+            if (sock < 0) continue;
+            if (::connect(sock, ai->ai_addr, ai->ai_addrlen) == 0) {
+                fd = sock;
+                break;
+            }
+            ::close(sock);
+        }
+        freeaddrinfo(result);
+        if (fd < 0) return false;
+        setup();
+        return true;
+    }
+
+    // Name resolution still blocks; the connect itself does not.
+    bool startConnect(const String &host, uint16_t port, uint32_t) override {
+        disconnect();
+        struct addrinfo hints;
+        memset(&hints, 0, sizeof(hints));
+        hints.ai_family = AF_INET;
+        hints.ai_socktype = SOCK_STREAM;
+        struct addrinfo *result = NULL;
+        if (getaddrinfo(host.c_str(), String(port).c_str(), &hints, &result) != 0) return false;
+        for (struct addrinfo *ai = result; ai; ai = ai->ai_next) {
+            int sock = ::socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+            if (sock < 0) continue;
+            fcntl(sock, F_SETFL, fcntl(sock, F_GETFL) | O_NONBLOCK);
+            if (::connect(sock, ai->ai_addr, ai->ai_addrlen) == 0 || errno == EINPROGRESS) {
+                fd = sock;
+                break;
+            }
+            ::close(sock);
+        }
+        freeaddrinfo(result);
+        if (fd < 0) return false;
+        connecting = true;
+        return true;
+    }
+
+    // Once the socket turns writable, the connect either went through or
+    // left its error in SO_ERROR. The socket goes back to blocking mode for
+    // write().
+    ConnectStatus connectStatus() override {
+        if (fd < 0) return ConnectFailed;
+        if (!connecting) return ConnectDone;
+        struct pollfd pfd;
+        pfd.fd = fd;
+        pfd.events = POLLOUT;
+        pfd.revents = 0;
+        int res = ::poll(&pfd, 1, 0);
+        if (res == 0 || (res < 0 && errno == EINTR)) return ConnectPending;
+        int error = 0;
+        socklen_t len = sizeof(error);
+        if (res < 0 || getsockopt(fd, SOL_SOCKET, SO_ERROR, &error, &len) < 0 || error) {
+            disconnect();
+            return ConnectFailed;
+        }
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) & ~O_NONBLOCK);
+        connecting = false;
+        setup();
+        return ConnectDone;
+    }
+
+    size_t write(uint8_t *data, size_t len) override {
+        if (fd < 0) return 0;
+        size_t sent = 0;
+        while (sent < len) {
+            ssize_t res = ::send(fd, data + sent, len - sent, MSG_NOSIGNAL);
+            if (res < 0 && errno == EINTR) continue;
+            if (res <= 0) {
+                disconnect();
+                break;
+            }
+            sent += res;
+        }
+        return sent;
+    }
+
+    size_t write(const TCPBuffer *buffers, size_t count) override {
+        if (fd < 0) return 0;
+        struct iovec iov[8];
+        if (count > sizeof(iov) / sizeof(iov[0])) return TCPClient::write(buffers, count);
+        size_t total = 0;
+        size_t sent = 0;
+        size_t n = 0;
+        for (size_t i = 0; i < count; i++) {
+            if (!buffers[i].len) continue;
+            iov[n].iov_base = (void *)buffers[i].data;
+            iov[n].iov_len = buffers[i].len;
+            total += buffers[i].len;
+            n++;
+        }
+        struct iovec *cur = iov;
+        while (sent < total && fd >= 0) {
+            struct msghdr msg;
+            memset(&msg, 0, sizeof(msg));
+            msg.msg_iov = cur;
+            msg.msg_iovlen = n;
+            ssize_t res = ::sendmsg(fd, &msg, MSG_NOSIGNAL);
+            if (res < 0 && errno == EINTR) continue;
+            if (res <= 0) {
+                disconnect();
+                break;
+            }
+            sent += res;
+            while (n && (size_t)res >= cur->iov_len) {
+                res -= cur->iov_len;
+                cur++;
+                n--;
+            }
+            if (n) {
+                cur->iov_base = (uint8_t *)cur->iov_base + res;
+                cur->iov_len -= res;
+            }
+        }
+        return sent;
+    }
+
+    int writeSome(const TCPBuffer *buffers, size_t count) override {
+        if (fd < 0) return -1;
+        struct iovec iov[8];
+        size_t n = 0;
+        for (size_t i = 0; i < count && n < sizeof(iov) / sizeof(iov[0]); i++) {
+            if (!buffers[i].len) continue;
+            iov[n].iov_base = (void *)buffers[i].data;
+            iov[n].iov_len = buffers[i].len;
+            n++;
+        }
+        if (!n) return 0;
+        struct msghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = iov;
+        msg.msg_iovlen = n;
+        ssize_t res;
+        do {
+            res = ::sendmsg(fd, &msg, MSG_NOSIGNAL | MSG_DONTWAIT);
+        } while (res < 0 && errno == EINTR);
+        if (res >= 0) return res;
+        if (errno == EAGAIN || errno == EWOULDBLOCK) return 0;
+        disconnect();
+        return -1;
+    }
+
+    int read(uint8_t *buffer, size_t len) override {
+        if (fd < 0) return -1;
+        ssize_t res = ::recv(fd, buffer, len, MSG_DONTWAIT);
+        if (res > 0) return res;
+        if (res == 0 || (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)) disconnect();
+        return -1;
+    }
+
+    int available() override {
+        if (fd < 0) return 0;
+        int count = 0;
+        if (ioctl(fd, FIONREAD, &count) < 0) return 0;
+        return count;
+    }
+
+    // Once the peer hung up, open only until the data it sent before is read.
+    bool isOpen() override {
+        if (fd < 0) return false;
+        return !peerClosed || available() > 0;
+    }
+
+    // Called by a poller that saw the peer close or the socket fail.
+    void markHangup() {
+        peerClosed = true;
+    }
+
+    int connected() override {
+        if (fd < 0) return 0;
+        uint8_t data;
+        ssize_t res = ::recv(fd, &data, 1, MSG_PEEK | MSG_DONTWAIT);
+        if (res > 0) return 1;
+        if (res < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) return 1;
+        disconnect();
+        return 0;
+    }
+
+    IPAddress remoteIP() override {
+        return ip;
+    }
+
+    uint16_t remotePort() override {
+        return port;
+    }
+
+    int getFd() const {
+        return fd;
+    }
+
+    void disconnect() override {
+        if (fd < 0) return;
+        ::close(fd);
+        fd = -1;
+        connecting = false;
+    }
+
+   private:
+    int fd;
+    IPAddress ip;
+    uint16_t port;
+    bool peerClosed = false;
+    bool connecting = false;
+
+    void setup() {
+        peerClosed = false;
+        int flag = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &flag, sizeof(flag));
+#ifdef SO_NOSIGPIPE
+        setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &flag, sizeof(flag));
+#endif
+        struct sockaddr_in addr;
+        socklen_t addrLen = sizeof(addr);
+        if (getpeername(fd, (struct sockaddr *)&addr, &addrLen) == 0 && addr.sin_family == AF_INET) {
+            ip = IPAddress((const uint8_t *)&addr.sin_addr.s_addr);
+            port = ntohs(addr.sin_port);
+        }
+    }
+};
+
+#endif
@@ -0,0 +1,76 @@
+#ifndef TCP_POSIX_SERVER_H
+#define TCP_POSIX_SERVER_H
+
+#include "TCPPosixClient.h"
+#include "TCPServer.h"
+
+class TCPPosixServer : public TCPServer {
+   public:
+    TCPPosixServer(uint16_t port, uint8_t maxClients = 4)
+        : fd(-1), port(port), queueSize(maxClients) {}
+
+    ~TCPPosixServer() {
+        end();
+    }
+
+    TCPPosixServer(const TCPPosixServer &) = delete;
+    TCPPosixServer &operator=(const TCPPosixServer &) = delete;
+
+    void begin() override {
+        end();
+        fd = ::socket(AF_INET, SOCK_STREAM, 0);
+        if (fd < 0) return;
+        int flag = 1;
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &flag, sizeof(flag));
+        struct sockaddr_in addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_ANY);
+        addr.sin_port = htons(port);
+        // Non-blocking, so accept() can be called until the queue is empty.
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+        if (::bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 || ::listen(fd, queueSize) < 0) {
+            end();
+        }
+    }
+
+    std::shared_ptr<TCPClient> accept() override {
+        if (fd < 0) return nullptr;
+        int sock;
+        do {
+            sock = ::accept(fd, NULL, NULL);
+        } while (sock < 0 && errno == EINTR);
+        if (sock < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) return nullptr;
+            // ECONNABORTED, EMFILE and the like: more may be queued behind it.
+            return std::make_shared<TCPPosixClient>();
+        }
+        // Accepted sockets inherit O_NONBLOCK on some platforms; the client
+        // expects a blocking socket and uses MSG_DONTWAIT where it must not wait.
+        fcntl(sock, F_SETFL, fcntl(sock, F_GETFL, 0) & ~O_NONBLOCK);
+        return std::make_shared<TCPPosixClient>(sock);
+    }
+
+    int backlog() override {
+#ifdef __linux__
+        // For a listening socket tcpi_unacked is the current accept queue length.
+        struct tcp_info info;
+        socklen_t len = sizeof(info);
+        if (fd >= 0 && getsockopt(fd, IPPROTO_TCP, TCP_INFO, &info, &len) == 0) return info.tcpi_unacked;
+#endif
+        return -1;
+    }
+
+    void end() override {
+        if (fd < 0) return;
+        ::close(fd);
+        fd = -1;
+    }
+
+   protected:
+    int fd;
+    uint16_t port;
+    int queueSize;
+};
+
+#endif
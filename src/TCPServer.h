@@ -5,12 +5,29 @@
 
 #include "Arduino.h"
 #include "TCPClient.h"
+#include "TCPPoller.h"
 
 class TCPServer {
    public:
     virtual void begin() = 0;
+    // Returns the next pending connection, or nullptr once none is waiting.
+    // A connection that was reset before it was accepted, or that could not
+    // be accepted, comes back as a client that is not connected, so callers
+    // can tell it from an empty queue and carry on. Must not block.
     virtual std::shared_ptr<TCPClient> accept() = 0;
     virtual void end() = 0;
+
+    // Connections waiting in the listen queue, or -1 if the backend cannot tell.
+    virtual int backlog() {
+        return -1;
+    }
+
+    // Creates a readiness poller; the one created with listen set also
+    // reports pending connections. Backends without readiness support
+    // return nullptr, and WSServer polls every client instead.
+    virtual std::shared_ptr<TCPPoller> createPoller(bool) {
+        return nullptr;
+    }
 };
 
 #endif
\ No newline at end of file
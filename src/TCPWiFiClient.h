@@ -3,7 +3,10 @@
 
 #include "TCPClient.h"
 #ifdef ESP32
+#include <errno.h>
+
 #include "WiFi.h"
+#include "lwip/sockets.h"
 #elif defined(ESP8266)
 #include "ESP8266WiFi.h"
 #else
@@ -24,11 +27,59 @@ class TCPWiFiClient : public TCPClient {
         return client.connect(host.c_str(), port);
     }
 
+    // WiFiClient only connects in one blocking call, bounded by timeout.
+    bool startConnect(const String &host, uint16_t port, uint32_t timeout) override {
+        if (!WiFi.isConnected()) return false;
+#ifdef ESP32
+        return client.connect(host.c_str(), port, timeout);
+#else
+        client.setTimeout(timeout);
+        return client.connect(host.c_str(), port);
+#endif
+    }
+
     size_t write(uint8_t *data, size_t len) override {
         if (connected()) return client.write(data, len);
         return 0;
     }
 
+#ifdef ESP32
+    // Goes to the lwIP socket with MSG_DONTWAIT, so a full send buffer
+    // returns what fit instead of waiting for ACKs.
+    int writeSome(const TCPBuffer *buffers, size_t count) override {
+        int sock = client.fd();
+        if (sock < 0 || !connected()) return -1;
+        size_t written = 0;
+        for (size_t i = 0; i < count; i++) {
+            if (!buffers[i].len) continue;
+            int res = lwip_send(sock, buffers[i].data, buffers[i].len, MSG_DONTWAIT);
+            if (res < 0) {
+                if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+                client.stop();
+                return written ? written : -1;
+            }
+            written += res;
+            if ((size_t)res < buffers[i].len) break;
+        }
+        return written;
+    }
+#elif defined(ESP8266)
+    // Only writes what fits in the send window, so it never waits for ACKs.
+    int writeSome(const TCPBuffer *buffers, size_t count) override {
+        if (!connected()) return -1;
+        size_t written = 0;
+        for (size_t i = 0; i < count; i++) {
+            size_t room = client.availableForWrite();
+            if (!room) break;
+            size_t len = std::min(room, buffers[i].len);
+            size_t res = client.write(buffers[i].data, len);
+            written += res;
+            if (res < buffers[i].len) break;
+        }
+        return written;
+    }
+#endif
+
     int read(uint8_t *buffer, size_t len) override {
         if (available()) return client.read(buffer, len);
         return -1;
@@ -26,7 +26,9 @@ class TCPWiFiServer : public TCPServer {
     }
 
     std::shared_ptr<TCPClient> accept() override {
-        return std::make_shared<TCPWiFiClient>(server.available());
+        WiFiClient client = server.available();
+        if (!client) return nullptr;
+        return std::make_shared<TCPWiFiClient>(client);
     }
 
     void end() override {
@@ -1,18 +1,33 @@
 #include "WSClient.h"
 
+#ifdef ESP32
+#define WS_CLIENT_LOCK() std::lock_guard<std::recursive_mutex> guard(lock)
+#else
+#define WS_CLIENT_LOCK()
+#endif
+
 WSClient::WSClient()
-    : client(std::make_shared<TCPWiFiClient>()), state(Closed) {
+#if defined(ESP32) || defined(ESP8266)
+    : client(std::make_shared<TCPWiFiClient>()), state(Closed), rxBuffer(WS_RX_BUFFER_SIZE) {
+#else
+    : client(std::make_shared<TCPPosixClient>()), state(Closed), rxBuffer(WS_RX_BUFFER_SIZE) {
+#endif
     reshuffleMask();
 }
 
 WSClient::WSClient(std::shared_ptr<TCPClient> client)
-    : client(client), rmtIP(client->remoteIP()), rmtPort(client->remotePort()), state(client && client->connected() ? Connected : Closed) {
+    : client(client), rmtIP(client->remoteIP()), rmtPort(client->remotePort()), state(client && client->connected() ? Connected : Closed), rxBuffer(WS_RX_BUFFER_SIZE) {
     reshuffleMask();
 }
 
 WSClient::~WSClient() {
 #ifdef ESP32
-    if (handler) vTaskDelete(handler);
+    if (handler) {
+        // Under the lock, so the task is not stopped halfway through run().
+        WS_CLIENT_LOCK();
+        vTaskDelete(handler);
+        handler = NULL;
+    }
 #endif
 }
 
@@ -20,7 +35,8 @@ void WSClient::addHeader(const String& key, const String& value) {
     customHeaders.push_back({key, value});
 }
 
-bool WSClient::begin(String url) {
+bool WSClient::begin(String url, bool wait) {
+    WS_CLIENT_LOCK();
     if (!client) {
         if (errorCallback) errorCallback(*this, "Client is not initialized");
         return false;
@@ -55,189 +71,617 @@ bool WSClient::begin(String url) {
 
     _close();
 
-    state = Connecting;
-    if (client->begin(host, port, path, customHeaders)) {
-        if (openCallback) openCallback(*this);
-        state = Connected;
-#ifdef ESP32
-        if (!handler) xTaskCreate(pollingTask, "pollingTask", 2 * 8192, this, 1, &handler);
-#endif
-        rmtIP = client->remoteIP();
-        rmtPort = client->remotePort();
-        return true;
+    autoReconnect = true;
+    reconnectPending = false;
+    reconnectAttempt = 0;
+    reconnectDelay = 0;
+    bool started = open(false);
+    if (wait) {
+        while (isOpening()) {
+            poll();
+            if (isOpening()) delay(1);
+        }
+        started = state == Connected;
     }
-    if (errorCallback) errorCallback(*this, "Cannot connect to " + url);
-    state = Closed;
 #ifdef ESP32
     if (!handler) xTaskCreate(pollingTask, "pollingTask", 2 * 8192, this, 1, &handler);
 #endif
-    return false;
+    return started;
 }
 
-bool WSClient::send(String data) {
-    if (!client) return false;
-    if (data.length() > 65535) return false;
-    if (useMask) Crypto::remaskData(data, maskingKey);
-    uint16_t len = data.length();
-    Frame::Header header(1, 0, useMask ? 1 : 0, Frame::Text, len);
-    uint16_t bin = header.getBinary();
-    uint16_t extendedPayload = header.getExtendedPayload();
-    uint8_t payload[len > 125 ? len + (useMask ? 8 : 4) : len + (useMask ? 6 : 2)];
-    memcpy(payload, (uint8_t*)&bin, 2);
-    if (len > 125) {
-        memcpy(payload + 2, (uint8_t*)&extendedPayload, 2);
-        if (useMask) memcpy(payload + 4, maskingKey, 4);
-        memcpy(payload + (useMask ? 8 : 4), (uint8_t*)data.c_str(), len);
+bool WSClient::isOpening() {
+    return state == Connecting || state == Handshaking;
+}
+
+// Starts connecting to host and port. From there poll() takes the
+// connection through the upgrade and fires onOpen, or onError if it fails.
+bool WSClient::open(bool reconnect) {
+    txQueue.clear();
+    txQueued = 0;
+    txBlocked = false;
+    lingering = false;
+    rxBuffer.clear();
+    parser.reset();
+    resetMessage();
+    opening.reset(new Opening());
+    opening->reconnect = reconnect;
+    opening->started = millis();
+    state = Connecting;
+    if (!client->startConnect(host, port, connectTimeout)) {
+        openFailed("connect failed");
+        return false;
+    }
+    return true;
+}
+
+// One step of an outbound connection: wait for the TCP connect, send the
+// upgrade request, then read the response. True once the connection is open.
+bool WSClient::advanceOpening() {
+    uint32_t now = millis();
+    if (state == Connecting) {
+        TCPClient::ConnectStatus status = client->connectStatus();
+        if (status == TCPClient::ConnectFailed) {
+            openFailed("connect failed");
+            return false;
+        }
+        if (status == TCPClient::ConnectPending) {
+            if (now - opening->started > connectTimeout) openFailed("connect timed out");
+            return false;
+        }
+        std::vector<std::pair<String, String>> headers = customHeaders;
+        if (compressionEnabled && Deflate::isAvailable()) headers.push_back({"Sec-WebSocket-Extensions", Deflate::offer(compression)});
+        Crypto::HandshakeRequestResult handshake = Crypto::generateHandshake(host, path, headers);
+        opening->request = handshake.requestStr;
+        opening->accept = handshake.expectedAcceptKey;
+        opening->started = now;
+        state = Handshaking;
+    }
+
+    if (opening->sent < opening->request.length()) {
+        TCPBuffer buffer = {(const uint8_t*)opening->request.c_str() + opening->sent, opening->request.length() - opening->sent};
+        int res = client->writeSome(&buffer, 1);
+        if (res < 0) {
+            openFailed("connection lost");
+            return false;
+        }
+        opening->sent += res;
+    }
+    if (opening->sent < opening->request.length() || !readResponse()) {
+        if (isOpening() && now - opening->started > handshakeTimeout) openFailed("handshake timed out");
+        return false;
+    }
+
+    opening.reset();
+    reconnectAttempt = 0;
+    reconnectDelay = 0;
+    rmtIP = client->remoteIP();
+    rmtPort = client->remotePort();
+    state = Connected;
+    if (openCallback) openCallback(*this);
+    return true;
+}
+
+// Feeds the response to the parser as it arrives. Frames the server sent
+// right behind it stay in rxBuffer for readFrame(). True once the upgrade
+// went through and the extensions the server accepted are set up.
+bool WSClient::readResponse() {
+    HandshakeParser& response = opening->response;
+    HandshakeParser::Status status = response.status();
+    while (status == HandshakeParser::Incomplete) {
+        if (rxBuffer.empty() && !fillBuffer()) break;
+        size_t len = 0;
+        const uint8_t* data = rxBuffer.readPtr(len);
+        size_t consumed = 0;
+        status = response.feed(data, len, consumed);
+        rxBuffer.skip(consumed);
+    }
+    if (status == HandshakeParser::Incomplete) {
+        if (!client->isOpen()) openFailed("connection closed");
+        return false;
+    }
+    if (!response.isUpgrade() || strcmp(response.key(), opening->accept.c_str())) {
+        openFailed("upgrade refused");
+        return false;
+    }
+
+    deflate.reset();
+    const char* extensions = response.extensions();
+    if (*extensions) {
+        Deflate::Config config;
+        if (!compressionEnabled || !Deflate::configure(extensions, compression, config)) {
+            openFailed("unsupported extensions");
+            return false;
+        }
+        deflate = std::make_shared<Deflate>(config);
+    }
+    return true;
+}
+
+void WSClient::openFailed(const String& reason) {
+    bool reconnect = opening && opening->reconnect;
+    opening.reset();
+    state = Closed;
+    client->end();
+    rxBuffer.clear();
+    if (!errorCallback) return;
+    if (reconnect) {
+        errorCallback(*this, "Reconnection failed: " + reason);
     } else {
-        if (useMask) memcpy(payload + 2, maskingKey, 4);
-        memcpy(payload + (useMask ? 6 : 2), (uint8_t*)data.c_str(), len);
+        errorCallback(*this, "Cannot connect to " + host + ":" + String(port) + path + ": " + reason);
     }
-    if (useMask) reshuffleMask();
-    return client->write(payload, sizeof(payload));
 }
 
-bool WSClient::ping(String data) {
+bool WSClient::send(const String& data) {
+    WS_CLIENT_LOCK();
+    if (!client || txOpcode) return false;
+    return writeMessage(Frame::Text, (const uint8_t*)data.c_str(), data.length());
+}
+
+bool WSClient::sendBinary(const uint8_t* data, size_t len) {
+    WS_CLIENT_LOCK();
+    if (!client || txOpcode) return false;
+    return writeMessage(Frame::Binary, data, len);
+}
+
+bool WSClient::beginMessage(bool binary) {
+    WS_CLIENT_LOCK();
+    if (!client || txOpcode) return false;
+    txOpcode = binary ? Frame::Binary : Frame::Text;
+    txFragments = 0;
+    return true;
+}
+
+bool WSClient::appendMessage(const uint8_t* data, size_t len) {
+    WS_CLIENT_LOCK();
+    if (!client || !txOpcode) return false;
+    size_t frameSize = fragmentSize ? fragmentSize : len;
+    size_t sent = 0;
+    while (sent < len) {
+        size_t chunk = std::min(frameSize, len - sent);
+        Frame::Opcode opcode = txFragments++ ? Frame::Continuation : Frame::Opcode(txOpcode);
+        if (!writeFrame(opcode, data + sent, chunk, false)) return false;
+        sent += chunk;
+    }
+    return true;
+}
+
+bool WSClient::appendMessage(const String& data) {
+    return appendMessage((const uint8_t*)data.c_str(), data.length());
+}
+
+bool WSClient::endMessage() {
+    WS_CLIENT_LOCK();
+    if (!client || !txOpcode) return false;
+    Frame::Opcode opcode = txFragments ? Frame::Continuation : Frame::Opcode(txOpcode);
+    txOpcode = 0;
+    txFragments = 0;
+    return writeFrame(opcode, NULL, 0);
+}
+
+void WSClient::setFragmentSize(size_t size) {
+    fragmentSize = size;
+}
+
+void WSClient::setCompression(const Deflate::Options& options) {
+    compression = options;
+    compressionEnabled = true;
+}
+
+bool WSClient::isCompressed() {
+    return deflate != nullptr;
+}
+
+bool WSClient::ping(const String& data) {
+    WS_CLIENT_LOCK();
     if (!client) return false;
-    uint16_t len = data.length();
-    if (useMask) Crypto::remaskData(data, maskingKey);
-    Frame::Header header(1, 0, useMask ? 1 : 0, Frame::Ping, len);
-    uint16_t bin = header.getBinary();
-    uint8_t payload[len + (useMask ? 6 : 2)];
-    memcpy(payload, (uint8_t*)&bin, 2);
-    if (useMask) memcpy(payload + 2, maskingKey, 4);
-    memcpy(payload + (useMask ? 6 : 2), (uint8_t*)data.c_str(), len);
-    if (useMask) reshuffleMask();
-    return client->write(payload, sizeof(payload));
-}
-
-bool WSClient::pong(String data) {
+    return writeFrame(Frame::Ping, (const uint8_t*)data.c_str(), data.length());
+}
+
+bool WSClient::pong(const String& data) {
+    WS_CLIENT_LOCK();
     if (!client) return false;
-    uint16_t len = data.length();
-    if (useMask) Crypto::remaskData(data, maskingKey);
-    Frame::Header header(1, 0, useMask ? 1 : 0, Frame::Pong, len);
-    uint16_t bin = header.getBinary();
-    uint8_t payload[len + (useMask ? 6 : 2)];
-    memcpy(payload, (uint8_t*)&bin, 2);
-    if (useMask) memcpy(payload + 2, maskingKey, 4);
-    memcpy(payload + (useMask ? 6 : 2), (uint8_t*)data.c_str(), len);
-    if (useMask) reshuffleMask();
-    return client->write(payload, sizeof(payload));
+    return writeFrame(Frame::Pong, (const uint8_t*)data.c_str(), data.length());
+}
+
+bool WSClient::writeMessage(Frame::Opcode opcode, const uint8_t* data, size_t len) {
+    WS_CLIENT_LOCK();
+    if (overflowed(true)) return false;
+    if (deflate && len >= deflate->getConfig().threshold && deflate->compress(data, len, txDeflated)) {
+        return writeFrame(opcode, txDeflated.data(), txDeflated.size(), true, Deflate::Rsv1);
+    }
+    return writeFrame(opcode, data, len);
+}
+
+bool WSClient::writeFrame(Frame::Opcode opcode, const uint8_t* data, size_t len, bool fin, uint8_t flags) {
+    if (!Frame::isControl(opcode) && overflowed(false)) return false;
+    Frame::Header header(fin ? 1 : 0, flags, useMask ? 1 : 0, opcode, len);
+    if (!useMask) {
+        uint8_t head[Frame::MaxHeaderSize];
+        size_t headLen = header.encode(head);
+        TCPBuffer buffers[2] = {{head, headLen}, {data, len}};
+        return transmit(buffers, 2);
+    }
+
+    // Masked frames are masked while being copied into the tx buffer, one
+    // buffer-sized chunk at a time, so the payload is only touched once.
+    if (txBuffer.size() != WS_TX_BUFFER_SIZE) txBuffer.resize(WS_TX_BUFFER_SIZE);
+    uint8_t* out = txBuffer.data();
+    size_t offset = header.encode(out);
+    memcpy(out + offset, maskingKey, 4);
+    offset += 4;
+    size_t sent = 0;
+    bool ok = true;
+    do {
+        size_t chunk = std::min(len - sent, txBuffer.size() - offset);
+        Mask::copy(out + offset, data + sent, chunk, maskingKey, sent);
+        TCPBuffer buffer = {out, offset + chunk};
+        ok = transmit(&buffer, 1);
+        sent += chunk;
+        offset = 0;
+    } while (ok && sent < len);
+    reshuffleMask();
+    return ok;
+}
+
+// Writes a frame encoded by the server for several connections. Whatever
+// the socket does not take is queued without copying the frame.
+bool WSClient::writeShared(const std::shared_ptr<const std::vector<uint8_t>>& frame) {
+    WS_CLIENT_LOCK();
+    if (isOpening()) return false;
+    if (overflowed(true)) return false;
+    size_t written = 0;
+    if (txQueue.empty()) {
+        TCPBuffer buffer = {frame->data(), frame->size()};
+        int res = client->writeSome(&buffer, 1);
+        if (res < 0) return false;
+        written = res;
+    }
+    if (written < frame->size()) enqueue(frame, written);
+    return true;
+}
+
+// Writes what the socket takes right now and queues a copy of the rest.
+// Once anything is queued, later frames go behind it to keep them in order.
+bool WSClient::transmit(const TCPBuffer* buffers, size_t count) {
+    if (isOpening()) return false;
+    size_t written = 0;
+    if (txQueue.empty()) {
+        int res = client->writeSome(buffers, count);
+        if (res < 0) return false;
+        written = res;
+    }
+    size_t total = 0;
+    for (size_t i = 0; i < count; i++) total += buffers[i].len;
+    if (written == total) return true;
+
+    std::shared_ptr<std::vector<uint8_t>> rest = std::make_shared<std::vector<uint8_t>>();
+    rest->reserve(total - written);
+    for (size_t i = 0; i < count; i++) {
+        if (written >= buffers[i].len) {
+            written -= buffers[i].len;
+            continue;
+        }
+        rest->insert(rest->end(), buffers[i].data + written, buffers[i].data + buffers[i].len);
+        written = 0;
+    }
+    enqueue(rest, 0);
+    return true;
 }
 
+void WSClient::enqueue(const std::shared_ptr<const std::vector<uint8_t>>& data, size_t offset) {
+    Outbound pending = {data, offset};
+    txQueue.push_back(pending);
+    txQueued += data->size() - offset;
+    if (txQueued >= highWatermark) txBlocked = true;
+}
+
+// Applies the overflow policy when a send finds more than maxQueued bytes
+// waiting. Checking before queueing lets one message overshoot the limit,
+// so messages larger than it can still be sent to a healthy peer.
+// DropMessage only refuses whole messages: frames of a fragmented message
+// already under way still go out.
+bool WSClient::overflowed(bool whole) {
+    if (txQueued <= maxQueued) return false;
+    if (overflowPolicy == DropMessage) return whole;
+    abort(CloseReason_PolicyViolation, "Outbound queue over limit");
+    return true;
+}
+
+// Sends as much of the outbound queue as the socket takes without blocking.
+// Returns true once nothing is left to send, including when the connection
+// is gone.
+bool WSClient::flush() {
+    WS_CLIENT_LOCK();
+    while (!txQueue.empty()) {
+        TCPBuffer buffers[8];
+        size_t count = 0;
+        size_t total = 0;
+        for (auto it = txQueue.begin(); it != txQueue.end() && count < 8; ++it, ++count) {
+            buffers[count].data = it->data->data() + it->offset;
+            buffers[count].len = it->data->size() - it->offset;
+            total += buffers[count].len;
+        }
+        int res = client->writeSome(buffers, count);
+        if (res < 0) {
+            txQueue.clear();
+            txQueued = 0;
+            break;
+        }
+        txQueued -= res;
+        for (size_t done = res; done;) {
+            Outbound& front = txQueue.front();
+            size_t left = front.data->size() - front.offset;
+            if (done < left) {
+                front.offset += done;
+                break;
+            }
+            done -= left;
+            txQueue.pop_front();
+        }
+        if ((size_t)res < total) break;
+    }
+    if (txBlocked && txQueued <= lowWatermark) {
+        txBlocked = false;
+        if (drainCallback) drainCallback(*this);
+    }
+    return txQueue.empty();
+}
+
+// Drops the connection without the closing handshake, discarding anything
+// queued: the stream may end mid-frame, so no close frame can follow.
+void WSClient::abort(CloseReason code, const String& reason) {
+    txQueue.clear();
+    txQueued = 0;
+    txBlocked = false;
+    lingering = false;
+    state = Closed;
+    closedAt = millis();
+    client->end();
+    rxBuffer.clear();
+    parser.reset();
+    resetMessage();
+    if (closeCallback) closeCallback(*this, String((uint16_t)code) + " -> " + getReason(code) + ": " + reason);
+}
+
+void WSClient::setWatermarks(size_t high, size_t low) {
+    highWatermark = high;
+    lowWatermark = std::min(low, high);
+}
+
+void WSClient::setMaxQueuedBytes(size_t limit, OverflowPolicy policy) {
+    maxQueued = limit;
+    overflowPolicy = policy;
+}
+
+size_t WSClient::getQueuedBytes() {
+    return txQueued;
+}
+
+// False from the high watermark until onDrain fires.
+bool WSClient::isWritable() {
+    return state == Connected && !txBlocked;
+}
+
+// Stops reconnecting as well. On ESP32 the polling task stays: with
+// nothing to reconnect run() is idle, and a later begin() reuses it.
 bool WSClient::close(CloseReason code, String reason) {
-#ifdef ESP32
-    if (handler) vTaskDelete(handler);
-#endif
+    WS_CLIENT_LOCK();
+    autoReconnect = false;
+    reconnectPending = false;
     return _close(code, reason);
 }
 
 bool WSClient::_close(CloseReason code, String reason) {
+    if (client && isOpening()) {
+        opening.reset();
+        state = Closed;
+        client->end();
+        return true;
+    }
     if (!client || state != Connected) return false;
     state = Closed;
+    closedAt = millis();
     String data(char((uint16_t)code >> 8) + String(char((uint16_t)code)) + (reason.length() > 0 ? reason : getReason(code)));
-    if (useMask) Crypto::remaskData(data, maskingKey);
-    uint16_t len = data.length();
-    Frame::Header header(1, 0, useMask ? 1 : 0, Frame::Close, len);
-    uint16_t bin = header.getBinary();
-    uint8_t payload[len + (useMask ? 6 : 2)];
-    memcpy(payload, (uint8_t*)&bin, 2);
-    if (useMask) memcpy(payload + 2, maskingKey, 4);
-    memcpy(payload + (useMask ? 6 : 2), (uint8_t*)data.c_str(), len);
-    int res = client->write(payload, sizeof(payload));
-    client->end();
+    bool res = writeFrame(Frame::Close, (const uint8_t*)data.c_str(), data.length());
+    // Queued data and the close frame get WS_CLOSE_LINGER ms to go out;
+    // poll() closes the socket once they have.
+    if (flush()) {
+        client->end();
+    } else {
+        lingering = true;
+    }
+    rxBuffer.clear();
+    parser.reset();
+    resetMessage();
     if (closeCallback) closeCallback(*this, String((uint16_t)code) + " -> " + getReason(code) + (reason.length() > 0 ? ": " + reason : ""));
-    if (useMask) reshuffleMask();
     return res;
 }
 
 bool WSClient::isConnected() {
-    if (!client) return false;
+    if (!client || lingering || isOpening()) return false;
     return client->connected();
 }
 
+// Starts a new connection to the last URL, like begin() without waiting.
 bool WSClient::reconnect() {
-    if (!client) return false;
-    if (state == Connecting) return false;
-    state = Connecting;
-    if (client->begin(host, port, path, customHeaders)) {
-        if (openCallback) openCallback(*this);
-        rmtIP = client->remoteIP();
-        rmtPort = client->remotePort();
-        state = Connected;
-        return true;
-    }
-    state = Closed;
-    if (errorCallback) errorCallback(*this, "Reconnection failed");
-    return false;
+    WS_CLIENT_LOCK();
+    if (!client || isOpening()) return false;
+    return open(true);
 }
 
 void WSClient::poll() {
-    if (!client || !client->available()) return;
-    uint16_t bin = 0;
-    int i = 0;
-    while (isConnected()) {
-        int res = client->read();
-        if (res >= 0) bin |= ((uint8_t)res) << i++ * 8;
-        if (i > 1) break;
-    }
-
-    Frame::Header header(bin);
-    uint16_t payloadLen = header.payload;
-    if ((useMask && header.mask) || (!useMask && !header.mask) || !Frame::isValid(Frame::Opcode(header.opcode))) {
-        _close(CloseReason_ProtocolError);
-        return;
-    }
-    if (header.opcode == 0) {
-        _close(CloseReason_UnsupportedData);
+    WS_CLIENT_LOCK();
+    if (!client) return;
+    if (isOpening() && !advanceOpening()) return;
+    if (lingering) {
+        if (flush() || millis() - closedAt > WS_CLOSE_LINGER) {
+            lingering = false;
+            txQueue.clear();
+            txQueued = 0;
+            client->end();
+        }
         return;
     }
-    if (header.payload == 127) {
-        _close(CloseReason_MessageTooBig);
-        return;
+    if (!txQueue.empty()) flush();
+    fillBuffer();
+    while (readFrame()) {
     }
-    if (header.payload == 126) {
-        bin = 0;
-        i = 0;
-        while (isConnected()) {
-            int res = client->read();
-            if (res >= 0) bin |= ((uint8_t)res) << i++ * 8;
-            if (i > 1) break;
+}
+
+bool WSClient::readStream() {
+    uint8_t* chunk = rxPayload.data();
+    bool fin = parser.header.fin;
+    do {
+        uint64_t offset = rxMessageLength + parser.received;
+        size_t len = std::min((uint64_t)rxPayload.size(), parser.remaining());
+        size_t res = parser.readPayload(rxBuffer, chunk, len);
+        if (!res && len) {
+            int n = client->read(chunk, len);
+            if (n <= 0) return false;
+            parser.consume(chunk, n);
+            res = n;
+        }
+        bool done = parser.remaining() == 0;
+        if (done) {
+            rxMessageLength += parser.length;
+            parser.reset();
+            if (fin) {
+                rxOpcode = 0;
+                rxStreaming = false;
+            }
         }
-        payloadLen = Crypto::swapEndianness(bin);
+        if (streamCallback && (res || (done && fin))) streamCallback(*this, chunk, res, offset, done && fin);
+        if (done || state != Connected) break;
+    } while (true);
+    return state == Connected;
+}
+
+bool WSClient::receivePayload(uint8_t* payload) {
+    parser.readPayload(rxBuffer, payload + parser.received, parser.remaining());
+    while (parser.remaining() > 0) {
+        int res = client->read(payload + parser.received, parser.remaining());
+        if (res <= 0) return false;
+        parser.consume(payload + parser.received, res);
     }
+    return true;
+}
+
+size_t WSClient::fillBuffer() {
+    size_t total = 0;
+    while (rxBuffer.space()) {
+        size_t len = 0;
+        uint8_t* ptr = rxBuffer.writePtr(len);
+        int res = client->read(ptr, len);
+        if (res <= 0) break;
+        rxBuffer.commit(res);
+        total += res;
+        if ((size_t)res < len) break;
+    }
+    return total;
+}
 
-    uint8_t maskingKey[4];
-    if (header.mask) {
-        i = 0;
-        while (isConnected()) {
-            int res = client->read();
-            if (res >= 0) maskingKey[i++] = (uint8_t)res;
-            if (i > 3) break;
+bool WSClient::readFrame() {
+    if (state != Connected) return false;
+    if (parser.state != FrameParser::ReadPayload) {
+        if (!parser.readHeader(rxBuffer)) return false;
+        if (!beginFrame()) return false;
+    }
+    if (Frame::isControl(parser.header.opcode)) return readControl();
+    if (rxStreaming) return readStream();
+
+    if (rxCompressed) {
+        if (!receivePayload(rxDeflated.data())) return false;
+        Deflate::Result res = deflate->decompress(rxDeflated.data(), parser.length, parser.header.fin, rxPayload, rxMessageLength, maxMessageSize);
+        if (res != Deflate::Ok) {
+            _close(res == Deflate::TooBig ? CloseReason_MessageTooBig : CloseReason_InvalidPayloadData);
+            return false;
         }
-        if (i != 4) {
+    } else {
+        if (!receivePayload(rxPayload.data() + rxMessageLength)) return false;
+        rxMessageLength += parser.length;
+    }
+    bool fin = parser.header.fin;
+    parser.reset();
+    if (!fin) return true;
+
+    uint8_t opcode = rxOpcode;
+    size_t len = rxMessageLength;
+    uint8_t* payload = rxPayload.data();
+    rxOpcode = 0;
+    rxMessageLength = 0;
+    if (opcode == Frame::Binary && binaryCallback) {
+        binaryCallback(*this, payload, len);
+    } else if (messageCallback) {
+        payload[len] = 0;
+        messageCallback(*this, String((const char*)payload));
+    }
+    return state == Connected;
+}
+
+// Validates a freshly parsed header and prepares the buffers its payload
+// goes into. Data frames either extend the message being reassembled or,
+// once it outgrows maxMessageSize, switch it over to onStream.
+bool WSClient::beginFrame() {
+    Frame::Header& header = parser.header;
+    bool messageStart = header.opcode == Frame::Text || header.opcode == Frame::Binary;
+    uint8_t allowedFlags = deflate && messageStart ? Deflate::Rsv1 : 0;
+    if ((useMask && header.mask) || (!useMask && !header.mask) || !Frame::isValid(Frame::Opcode(header.opcode)) || parser.length >> 63 || (header.flags & ~allowedFlags)) {
+        _close(CloseReason_ProtocolError);
+        return false;
+    }
+    if (Frame::isControl(header.opcode)) {
+        if (!header.fin || parser.length > 125) {
             _close(CloseReason_ProtocolError);
-            return;
+            return false;
         }
+        return true;
     }
 
-    char payload[payloadLen + 1];
-    payload[payloadLen] = 0;
-    i = 0;
-    if (payloadLen > 0) {
-        while (isConnected()) {
-            int res = client->read();
-            if (res > 0) payload[i++] = res;
-            if (i >= payloadLen) break;
+    if ((header.opcode == Frame::Continuation) != (rxOpcode != 0)) {
+        _close(CloseReason_ProtocolError);
+        return false;
+    }
+    if (header.opcode != Frame::Continuation) {
+        rxOpcode = header.opcode;
+        rxMessageLength = 0;
+        rxStreaming = false;
+        rxCompressed = header.flags & Deflate::Rsv1;
+    }
+    if (rxCompressed) {
+        // Compressed frames are inflated whole, so they cannot be streamed.
+        if (parser.length > maxMessageSize) {
+            _close(CloseReason_MessageTooBig);
+            return false;
+        }
+        rxDeflated.resize(parser.length);
+        return true;
+    }
+    if (!rxStreaming && rxMessageLength + parser.length > maxMessageSize) {
+        if (!streamCallback) {
+            _close(CloseReason_MessageTooBig);
+            return false;
         }
+        rxStreaming = true;
+        if (rxMessageLength) streamCallback(*this, rxPayload.data(), rxMessageLength, 0, false);
+        if (state != Connected) return false;
+    }
+    if (rxStreaming) {
+        if (rxPayload.size() < WS_RX_BUFFER_SIZE) rxPayload.resize(WS_RX_BUFFER_SIZE);
+    } else {
+        rxPayload.resize(rxMessageLength + parser.length + 1);
     }
+    return true;
+}
 
-    String payloadData(payload);
-    if (header.mask) Crypto::remaskData(payloadData, maskingKey);
-    switch (header.opcode) {
-        case Frame::Text:
-        case Frame::Binary:
-            if (messageCallback) messageCallback(*this, payloadData);
-            break;
+bool WSClient::readControl() {
+    if (!receivePayload(controlPayload)) return false;
+    uint8_t opcode = parser.header.opcode;
+    size_t len = parser.length;
+    parser.reset();
+
+    controlPayload[len] = 0;
+    String payloadData((const char*)controlPayload);
+    switch (opcode) {
         case Frame::Ping:
             pong(payloadData);
             if (pingCallback) pingCallback(*this, payloadData);
@@ -247,23 +691,62 @@ void WSClient::poll() {
             break;
         case Frame::Close:
             uint16_t closeReason = CloseReason_NormalClosure;
-            if (payloadLen >= 2) {
-                closeReason = (payloadData[0] << 8) + payloadData[1];
-                closeReason = Crypto::swapEndianness(closeReason);
-            }
+            if (len >= 2) closeReason = (controlPayload[0] << 8) | controlPayload[1];
             _close(static_cast<CloseReason>(closeReason));
-            break;
+            return false;
     }
+    return state == Connected;
+}
+
+void WSClient::resetMessage() {
+    rxOpcode = 0;
+    rxMessageLength = 0;
+    rxStreaming = false;
+    rxCompressed = false;
+    txOpcode = 0;
+    txFragments = 0;
+}
+
+void WSClient::setConnectTimeout(uint32_t timeout) {
+    connectTimeout = timeout;
+}
+
+void WSClient::setHandshakeTimeout(uint32_t timeout) {
+    handshakeTimeout = timeout;
+}
+
+void WSClient::setReconnectPolicy(const ReconnectPolicy& policy) {
+    reconnectPolicy = policy;
+}
+
+// Reconnect attempts made since the connection was last open.
+uint32_t WSClient::getReconnectAttempt() {
+    return reconnectAttempt;
+}
+
+// millis() at which run() makes the next attempt, 0 if none is scheduled.
+uint32_t WSClient::getNextReconnect() {
+    return reconnectPending ? nextReconnect : 0;
 }
 
 void WSClient::setUseMask(bool useMask) {
     this->useMask = useMask;
 }
 
+void WSClient::setMaxMessageSize(size_t size) {
+    maxMessageSize = size;
+}
+
 void WSClient::onOpen(EmptyCallback callback) {
     openCallback = callback;
 }
 
+// Called once the outbound queue is back down to the low watermark after
+// reaching the high one.
+void WSClient::onDrain(EmptyCallback callback) {
+    drainCallback = callback;
+}
+
 void WSClient::onClose(StringCallback callback) {
     closeCallback = callback;
 }
@@ -272,6 +755,10 @@ void WSClient::onMessage(StringCallback callback) {
     messageCallback = callback;
 }
 
+void WSClient::onBinary(BinaryCallback callback) {
+    binaryCallback = callback;
+}
+
 void WSClient::onPing(StringCallback callback) {
     pingCallback = callback;
 }
@@ -284,6 +771,10 @@ void WSClient::onError(StringCallback callback) {
     errorCallback = callback;
 }
 
+void WSClient::onStream(StreamCallback callback) {
+    streamCallback = callback;
+}
+
 IPAddress WSClient::remoteIP() {
     return rmtIP;
 }
@@ -323,16 +814,56 @@ void WSClient::reshuffleMask() {
     for (int i = 0; i < 4; i++) maskingKey[i] = random(256);
 }
 
+// Drives an opening connection, polls an open one, and otherwise reconnects
+// on the schedule the reconnect policy sets.
 void WSClient::run() {
-    if (isConnected()) {
+    WS_CLIENT_LOCK();
+    if (isOpening()) {
+        poll();
+    } else if (isConnected()) {
         if (state == Connected) poll();
-    } else if (millis() - lastReconnectAttempt > 15000) {
-        lastReconnectAttempt = millis();
-        if (state == Connected) _close(CloseReason_InternalServerError);
+    } else if (lingering) {
+        poll();
+    } else if (autoReconnect && !reconnectPending) {
+        scheduleReconnect();
+    } else if (reconnectPending && (int32_t)(millis() - nextReconnect) >= 0) {
+        reconnectPending = false;
+        reconnectAttempt++;
         reconnect();
     }
 }
 
+void WSClient::scheduleReconnect() {
+    if (state == Connected) _close(CloseReason_InternalServerError);
+    if (reconnectPolicy.maxAttempts && reconnectAttempt >= reconnectPolicy.maxAttempts) {
+        autoReconnect = false;
+        if (errorCallback) errorCallback(*this, "Gave up reconnecting after " + String(reconnectAttempt) + " attempts");
+        return;
+    }
+    reconnectDelay = backoff();
+    nextReconnect = millis() + reconnectDelay;
+    reconnectPending = true;
+}
+
+// Delay before the next attempt, from the policy and the attempts so far.
+uint32_t WSClient::backoff() {
+    const ReconnectPolicy& policy = reconnectPolicy;
+    float ceiling = policy.initialDelay;
+    for (uint32_t i = 0; i < reconnectAttempt && policy.multiplier > 1 && ceiling < policy.maxDelay; i++) ceiling *= policy.multiplier;
+    uint32_t cap = std::min<float>(ceiling, policy.maxDelay);
+    switch (policy.jitter) {
+        case ReconnectPolicy::FullJitter:
+            return random(cap + 1L);
+        case ReconnectPolicy::DecorrelatedJitter: {
+            uint32_t low = std::min(policy.initialDelay, policy.maxDelay);
+            uint32_t high = std::min<float>(std::max(reconnectDelay, low) * policy.multiplier, policy.maxDelay);
+            return random(low, std::max(low, high) + 1L);
+        }
+        default:
+            return cap;
+    }
+}
+
 #ifdef ESP32
 void WSClient::pollingTask(void* ptr) {
     WSClient* client = (WSClient*)ptr;
@@ -1,12 +1,104 @@
 #ifndef WEBSOCKET_CLIENT_H
 #define WEBSOCKET_CLIENT_H
 
+#include <deque>
 #include <functional>
 #include <memory>
+#ifdef ESP32
+#include <mutex>
+#endif
 
 #include "Arduino.h"
+#if defined(ESP32) || defined(ESP8266)
 #include "TCPWiFiClient.h"
+#else
+#include "TCPPosixClient.h"
+#endif
+#include "utilities/Crypto.h"
+#include "utilities/Deflate.h"
 #include "utilities/Frame.h"
+#include "utilities/FrameParser.h"
+#include "utilities/HandshakeParser.h"
+#include "utilities/RingBuffer.h"
+
+#ifndef WS_RX_BUFFER_SIZE
+#define WS_RX_BUFFER_SIZE 2048
+#endif
+
+#ifndef WS_TX_BUFFER_SIZE
+#if defined(ESP32) || defined(ESP8266)
+#define WS_TX_BUFFER_SIZE 2048
+#else
+#define WS_TX_BUFFER_SIZE 65536
+#endif
+#endif
+
+#ifndef WS_FRAGMENT_SIZE
+#define WS_FRAGMENT_SIZE 1400
+#endif
+
+#ifndef WS_MAX_MESSAGE_SIZE
+#define WS_MAX_MESSAGE_SIZE 65535
+#endif
+
+// Bytes the socket cannot take right away are queued and sent as it drains.
+// isWritable() turns false once WS_TX_HIGH_WATERMARK bytes are queued, and
+// onDrain fires when the queue is back down to WS_TX_LOW_WATERMARK. A send
+// while more than WS_TX_QUEUE_LIMIT bytes are queued triggers the overflow
+// policy.
+#ifndef WS_TX_HIGH_WATERMARK
+#if defined(ESP32) || defined(ESP8266)
+#define WS_TX_HIGH_WATERMARK 4096
+#else
+#define WS_TX_HIGH_WATERMARK (1 << 20)
+#endif
+#endif
+
+#ifndef WS_TX_LOW_WATERMARK
+#if defined(ESP32) || defined(ESP8266)
+#define WS_TX_LOW_WATERMARK 1024
+#else
+#define WS_TX_LOW_WATERMARK (256 << 10)
+#endif
+#endif
+
+// How long a closing connection may keep flushing queued data and the
+// close frame before the socket is closed anyway.
+#ifndef WS_CLOSE_LINGER
+#define WS_CLOSE_LINGER 1000
+#endif
+
+#ifndef WS_TX_QUEUE_LIMIT
+#if defined(ESP32) || defined(ESP8266)
+#define WS_TX_QUEUE_LIMIT 8192
+#else
+#define WS_TX_QUEUE_LIMIT (8 << 20)
+#endif
+#endif
+
+// begin() and reconnect() only start connecting; poll() carries the
+// connection through the upgrade. It is given up on, with onError, if the
+// TCP connect takes longer than WS_CONNECT_TIMEOUT ms or the server has not
+// answered the upgrade WS_HANDSHAKE_TIMEOUT ms after that. WSServer drops
+// clients whose upgrade request takes longer than WS_HANDSHAKE_TIMEOUT.
+#ifndef WS_CONNECT_TIMEOUT
+#define WS_CONNECT_TIMEOUT 5000
+#endif
+
+#ifndef WS_HANDSHAKE_TIMEOUT
+#define WS_HANDSHAKE_TIMEOUT 5000
+#endif
+
+// run() reconnects a dropped connection after a delay that starts around
+// WS_RECONNECT_DELAY ms and doubles with each failed attempt, up to
+// WS_RECONNECT_MAX_DELAY ms. See WSClient::ReconnectPolicy.
+#ifndef WS_RECONNECT_DELAY
+#define WS_RECONNECT_DELAY 1000
+#endif
+
+#ifndef WS_RECONNECT_MAX_DELAY
+#define WS_RECONNECT_MAX_DELAY 60000
+#endif
 
 enum CloseReason {
     CloseReason_None = -1,
@@ -26,35 +118,92 @@ class WSClient {
    public:
     using EmptyCallback = std::function<void(WSClient&)>;
     using StringCallback = std::function<void(WSClient&, String)>;
+    using BinaryCallback = std::function<void(WSClient&, const uint8_t* data, size_t len)>;
+    using StreamCallback = std::function<void(WSClient&, const uint8_t* data, size_t len, uint64_t offset, bool final)>;
+    // Assigned by WSServer: the handle packs the shard, slot and slot
+    // generation (0 for connections a server does not own), and id is its
+    // hex form, for display.
+    using Handle = uint64_t;
+    Handle handle = 0;
     String id;
 
+    // What a send does when the outbound queue is over its limit: close the
+    // connection (1008), or refuse new messages until it drains.
+    enum OverflowPolicy {
+        DropConnection,
+        DropMessage
+    };
+
+    // How run() spaces out reconnects. Attempt n (from 0) may wait up to
+    // initialDelay * multiplier^n ms, capped at maxDelay. FullJitter waits
+    // a random time up to that. DecorrelatedJitter waits between
+    // initialDelay and multiplier times the previous wait, capped. The count
+    // starts over once a connection opens; maxAttempts 0 never gives up.
+    struct ReconnectPolicy {
+        enum Jitter {
+            NoJitter,
+            FullJitter,
+            DecorrelatedJitter
+        };
+        uint32_t initialDelay = WS_RECONNECT_DELAY;
+        float multiplier = 2;
+        uint32_t maxDelay = WS_RECONNECT_MAX_DELAY;
+        Jitter jitter = FullJitter;
+        uint32_t maxAttempts = 0;
+    };
+
     WSClient();
     WSClient(std::shared_ptr<TCPClient> client);
     ~WSClient();
 
     void addHeader(const String &key, const String &value);
-    bool begin(String url);
-    bool send(String data);
-    bool ping(String data = "");
-    bool pong(String data = "");
+    bool begin(String url, bool wait = false);
+    bool send(const String& data);
+    bool sendBinary(const uint8_t* data, size_t len);
+    bool beginMessage(bool binary = false);
+    bool appendMessage(const uint8_t* data, size_t len);
+    bool appendMessage(const String& data);
+    bool endMessage();
+    bool ping(const String& data = "");
+    bool pong(const String& data = "");
     bool close(CloseReason code = CloseReason_GoingAway, String reason = "");
     bool isConnected();
     bool reconnect();
+    void setConnectTimeout(uint32_t timeout);
+    void setHandshakeTimeout(uint32_t timeout);
+    void setReconnectPolicy(const ReconnectPolicy& policy);
+    uint32_t getReconnectAttempt();
+    uint32_t getNextReconnect();
     void setUseMask(bool useMask);
+    void setMaxMessageSize(size_t size);
+    void setFragmentSize(size_t size);
+    void setCompression(const Deflate::Options& options = Deflate::Options());
+    bool isCompressed();
+    void setWatermarks(size_t high, size_t low);
+    void setMaxQueuedBytes(size_t limit, OverflowPolicy policy = DropConnection);
+    size_t getQueuedBytes();
+    bool isWritable();
+    bool flush();
     void poll();
     void onOpen(EmptyCallback callback);
     void onClose(StringCallback callback);
     void onMessage(StringCallback callback);
+    void onBinary(BinaryCallback callback);
     void onPing(StringCallback callback);
     void onPong(StringCallback callback);
     void onError(StringCallback callback);
+    void onStream(StreamCallback callback);
+    void onDrain(EmptyCallback callback);
     void run();
     IPAddress remoteIP();
     uint16_t remotePort();
 
    private:
+    friend class WSServer;
+
     enum State {
         Connecting,
+        Handshaking,
         Connected,
         Closed
     };
@@ -68,7 +217,60 @@ class WSClient {
     bool useMask = true;
     IPAddress rmtIP;
     uint16_t rmtPort;
-    uint32_t lastReconnectAttempt = 0;
+    ReconnectPolicy reconnectPolicy;
+    bool autoReconnect = false;     // set by begin(), cleared by close()
+    bool reconnectPending = false;  // a retry is due at nextReconnect
+    uint32_t reconnectAttempt = 0;
+    uint32_t reconnectDelay = 0;
+    uint32_t nextReconnect = 0;
+    uint32_t connectTimeout = WS_CONNECT_TIMEOUT;
+    uint32_t handshakeTimeout = WS_HANDSHAKE_TIMEOUT;
+
+    // Outbound upgrade under way, only allocated while connecting.
+    struct Opening {
+        Opening() : response(HandshakeParser::Response) {}
+        HandshakeParser response;
+        String request;
+        size_t sent = 0;
+        String accept;
+        uint32_t started = 0;  // start of the current step
+        bool reconnect = false;
+    };
+    std::unique_ptr<Opening> opening;
+    RingBuffer rxBuffer;
+    FrameParser parser;
+    std::vector<uint8_t> rxPayload;
+    std::vector<uint8_t> txBuffer;
+    uint8_t controlPayload[126];
+    uint8_t rxOpcode = 0;
+    size_t rxMessageLength = 0;
+    bool rxStreaming = false;
+    size_t maxMessageSize = WS_MAX_MESSAGE_SIZE;
+    uint8_t txOpcode = 0;
+    uint32_t txFragments = 0;
+    size_t fragmentSize = WS_FRAGMENT_SIZE;
+    bool compressionEnabled = false;
+    Deflate::Options compression;
+    std::shared_ptr<Deflate> deflate;
+    bool rxCompressed = false;
+    std::vector<uint8_t> rxDeflated;
+    std::vector<uint8_t> txDeflated;
+
+    // Part of the outbound stream not written yet. Broadcast frames are
+    // shared between every connection that queued them.
+    struct Outbound {
+        std::shared_ptr<const std::vector<uint8_t>> data;
+        size_t offset;
+    };
+    std::deque<Outbound> txQueue;
+    size_t txQueued = 0;
+    size_t highWatermark = WS_TX_HIGH_WATERMARK;
+    size_t lowWatermark = WS_TX_LOW_WATERMARK;
+    size_t maxQueued = WS_TX_QUEUE_LIMIT;
+    OverflowPolicy overflowPolicy = DropConnection;
+    bool txBlocked = false;  // reached the high watermark, onDrain pending
+    bool lingering = false;  // closed, still flushing before the socket goes
+    uint32_t closedAt = 0;
 
     EmptyCallback openCallback = NULL;
     StringCallback closeCallback = NULL;
@@ -76,13 +278,40 @@ class WSClient {
     StringCallback pingCallback = NULL;
     StringCallback pongCallback = NULL;
     StringCallback errorCallback = NULL;
+    BinaryCallback binaryCallback = NULL;
+    StreamCallback streamCallback = NULL;
+    EmptyCallback drainCallback = NULL;
 
     std::vector<std::pair<String, String>> customHeaders;
     String getReason(CloseReason reason);
     bool _close(CloseReason code = CloseReason_GoingAway, String reason = "");
+    bool isOpening();
+    bool open(bool reconnect);
+    bool advanceOpening();
+    bool readResponse();
+    void openFailed(const String& reason);
+    void scheduleReconnect();
+    uint32_t backoff();
+    bool writeMessage(Frame::Opcode opcode, const uint8_t* data, size_t len);
+    bool writeFrame(Frame::Opcode opcode, const uint8_t* data, size_t len, bool fin = true, uint8_t flags = 0);
+    bool writeShared(const std::shared_ptr<const std::vector<uint8_t>>& frame);
+    bool transmit(const TCPBuffer* buffers, size_t count);
+    void enqueue(const std::shared_ptr<const std::vector<uint8_t>>& data, size_t offset);
+    bool overflowed(bool whole);
+    void abort(CloseReason code, const String& reason);
     void reshuffleMask();
+    size_t fillBuffer();
+    bool readFrame();
+    bool beginFrame();
+    bool readControl();
+    bool readStream();
+    bool receivePayload(uint8_t* payload);
+    void resetMessage();
 #ifdef ESP32
     TaskHandle_t handler = NULL;
+    // pollingTask runs run() while loop() sends and closes, so calls that
+    // touch the connection hold this. Recursive: callbacks run under it.
+    std::recursive_mutex lock;
     static void pollingTask(void *ptr);
 #endif
 };
@@ -1,10 +1,20 @@
 #include "WSServer.h"
 
+thread_local WSServer::Shard* WSServer::currentShard = NULL;
+
 WSServer::WSServer(uint16_t port, uint8_t maxClients)
-    : server(std::make_shared<TCPWiFiServer>(port, maxClients)) {}
+#if defined(ESP32) || defined(ESP8266)
+    : WSServer(std::make_shared<TCPWiFiServer>(port, maxClients)) {}
+#elif defined(__linux__)
+    : WSServer(std::make_shared<TCPEpollServer>(port, maxClients)) {}
+#else
+    : WSServer(std::make_shared<TCPPosixServer>(port, maxClients)) {}
+#endif
 
 WSServer::WSServer(std::shared_ptr<TCPServer> server)
-    : server(server) {}
+    : server(server), running(false), pendingHandshakes(0), acceptRate(0), acceptPending(true) {
+    resetShards();
+}
 
 WSServer::~WSServer() {
     end();
@@ -15,19 +25,141 @@ WSServer::~WSServer() {
 
 void WSServer::begin() {
     if (!server) return;
+    stopWorkers();
+    acceptStats = AcceptStats();
+    acceptRate = 0;
+    acceptWindowStart = millis();
+    acceptWindowAccepted = 0;
+    acceptPending = true;
     server->begin();
+    if (shards.size() != std::max<uint8_t>(workers, 1)) resetShards();
+    for (auto& shard : shards) {
+        shard->accepted = 0;
+        shard->rejected = 0;
+        shard->timedOut = 0;
+        shard->reaped = 0;
+        shard->swept = 0;
+        shard->residentTotal = 0;
+        shard->residentMax = 0;
+        shard->poller = server->createPoller(shard->index == 0);
+        for (auto& client : shard->clients) {
+            if (shard->poller && !shard->poller->watch(client.client.get())) shard->poller.reset();
+        }
+    }
+
+    if (workers) {
+        running = true;
+        for (auto& shard : shards) {
+            Shard* ptr = shard.get();
+#ifdef ESP32
+            xTaskCreatePinnedToCore(workerTask, "serverWorker", 2 * 8192, ptr, 1, (TaskHandle_t*)&ptr->handler, ptr->index % portNUM_PROCESSORS);
+#elif WS_THREADS
+            ptr->thread = std::thread([this, ptr]() {
+                work(*ptr);
+            });
+#endif
+        }
+        return;
+    }
 #ifdef ESP32
     if (!handler) xTaskCreate(pollingTask, "serverTask", 2 * 8192, this, 1, &handler);
 #endif
 }
 
 void WSServer::end() {
+    stopWorkers();
+    for (auto& shard : shards) {
+        for (auto& pending : shard->handshakes) pending.client->end();
+        shard->load -= shard->handshakes.size();
+        shard->handshakes.clear();
+        Command command;
+        while (shard->inbox.pop(command)) {
+            if (command.type == Command::Adopt) command.client->end();
+        }
+        shard->poller.reset();
+    }
+    pendingHandshakes = 0;
     if (!server) return;
     server->end();
 }
 
-std::vector<WSClient>& WSServer::getClients() {
-    return clients;
+// With workers each shard owns its connections, so this returns the ones
+// of the worker calling it. Any other thread gets an empty map: a worker's
+// map changes under it at any time, so it cannot be iterated from outside.
+SlotMap<WSClient>& WSServer::getClients() {
+    static SlotMap<WSClient> none;
+    Shard* shard = localShard();
+    return shard ? shard->clients : none;
+}
+
+void WSServer::setCompression(const Deflate::Options& options) {
+    compression = options;
+    compressionEnabled = true;
+}
+
+void WSServer::setAcceptBatch(uint8_t batch) {
+    acceptBatch = batch ? batch : 1;
+}
+
+void WSServer::setHandshakeTimeout(uint32_t timeout) {
+    handshakeTimeout = timeout;
+}
+
+void WSServer::setMaxPendingHandshakes(uint16_t count) {
+    maxPendingHandshakes = count ? count : 1;
+}
+
+// Takes effect at the next begin(). With workers, begin() starts one event
+// loop per worker (a thread on hosts, a task pinned to alternating cores on
+// ESP32) and run() no longer needs to be called. Callbacks then run on the
+// worker that owns the connection. 0 goes back to a single loop driven by
+// run().
+void WSServer::setWorkers(uint8_t count, Balance balance) {
+#if WS_THREADS
+    workers = count;
+#endif
+    this->balance = balance;
+}
+
+// Outbound queue settings for connections accepted from now on; see
+// WSClient::setWatermarks() and WSClient::setMaxQueuedBytes().
+void WSServer::setWatermarks(size_t high, size_t low) {
+    highWatermark = high;
+    lowWatermark = low;
+}
+
+void WSServer::setMaxQueuedBytes(size_t limit, WSClient::OverflowPolicy policy) {
+    maxQueued = limit;
+    overflowPolicy = policy;
+}
+
+const WSServer::ReapStats& WSServer::getReapStats() {
+    uint32_t total = 0;
+    reapStats = ReapStats();
+    for (auto& shard : shards) {
+        reapStats.reaped += shard->reaped;
+        reapStats.swept += shard->swept;
+        reapStats.lingering += shard->lingering;
+        reapStats.maxResidentMs = std::max<uint32_t>(reapStats.maxResidentMs, shard->residentMax);
+        total += shard->residentTotal;
+    }
+    reapStats.avgResidentMs = reapStats.reaped ? total / reapStats.reaped : 0;
+    return reapStats;
+}
+
+const WSServer::AcceptStats& WSServer::getAcceptStats() {
+    acceptStats.accepted = 0;
+    acceptStats.rejected = 0;
+    acceptStats.timedOut = 0;
+    for (auto& shard : shards) {
+        acceptStats.accepted += shard->accepted;
+        acceptStats.rejected += shard->rejected;
+        acceptStats.timedOut += shard->timedOut;
+    }
+    acceptStats.pending = pendingHandshakes;
+    acceptStats.acceptRate = acceptRate;
+    acceptStats.backlog = server ? server->backlog() : -1;
+    return acceptStats;
 }
 
 void WSServer::onConnection(WSCallback callback) {
@@ -35,98 +167,740 @@ void WSServer::onConnection(WSCallback callback) {
 }
 
 void WSServer::poll() {
-    for (auto& client : clients) {
+    Shard* shard = localShard();
+    if (!shard) return;
+    for (auto& client : shard->clients) {
         client.poll();
+        if (!isAlive(client)) markDead(*shard, client);
     }
+    reap(*shard);
 }
 
 void WSServer::close(String id) {
-    for (auto& client : clients) {
-        if (client.id == id) {
-            client.close(CloseReason_AbnormalClosure);
-        }
+    close(parseHandle(id));
+}
+
+// Closes the connection directly when the calling thread owns it, and
+// otherwise queues the close for its worker.
+bool WSServer::close(WSClient::Handle handle) {
+    Shard* shard = shardOf(handle);
+    if (!shard) return false;
+    if (shard != localShard()) {
+        Command command;
+        command.type = Command::Close;
+        command.handle = handle;
+        post(*shard, command);
+        return true;
     }
+    WSClient* client = find(*shard, handle);
+    if (!client) return false;
+    client->close(CloseReason_AbnormalClosure);
+    markDead(*shard, *client);
+    return true;
 }
 
 bool WSServer::hasClients() {
-    return !clients.empty();
+    for (auto& shard : shards) {
+        if (shard->connected) return true;
+    }
+    return false;
 }
 
 bool WSServer::hasClient(String id) {
-    for (auto& client : clients) {
-        if (client.id == id) return true;
+    return hasClient(parseHandle(id));
+}
+
+bool WSServer::hasClient(WSClient::Handle handle) {
+    Shard* shard = shardOf(handle);
+    if (!shard) return false;
+#if WS_THREADS
+    std::lock_guard<std::mutex> guard(shard->lock);
+#endif
+    return find(*shard, handle) != NULL;
+}
+
+// Only resolves connections owned by the calling thread; see getClients().
+WSClient* WSServer::getClient(WSClient::Handle handle) {
+    Shard* shard = shardOf(handle);
+    if (!shard || shard != localShard()) return NULL;
+    return find(*shard, handle);
+}
+
+bool WSServer::send(WSClient::Handle handle, const String& data) {
+    return sendMessage(handle, Frame::Text, (const uint8_t*)data.c_str(), data.length());
+}
+
+bool WSServer::sendBinary(WSClient::Handle handle, const uint8_t* data, size_t len) {
+    return sendMessage(handle, Frame::Binary, data, len);
+}
+
+// Like close(handle): direct on the owning thread, queued otherwise, in
+// which case true only means the message was queued.
+bool WSServer::sendMessage(WSClient::Handle handle, Frame::Opcode opcode, const uint8_t* data, size_t len) {
+    Shard* shard = shardOf(handle);
+    if (!shard) return false;
+    if (shard != localShard()) {
+        Command command;
+        command.type = Command::Send;
+        command.handle = handle;
+        command.opcode = opcode;
+        command.payload = std::make_shared<std::vector<uint8_t>>(data, data + len);
+        post(*shard, command);
+        return true;
     }
+    WSClient* client = find(*shard, handle);
+    if (!client || !isAlive(*client) || client->txOpcode) return false;
+    if (client->writeMessage(opcode, data, len)) return true;
+    if (!isAlive(*client)) markDead(*shard, *client);
     return false;
 }
 
-void WSServer::cleanup() {
-    for (int i = 0; i < clients.size(); i++) {
-        if (!clients[i].isConnected()) {
-            clients[i].close(CloseReason_AbnormalClosure);
-            clients.erase(clients.begin() + i);
-            i--;
+// Handle layout: generation in the top 32 bits, then the shard index in 8
+// bits and the slot in the low 24.
+WSServer::Shard* WSServer::shardOf(WSClient::Handle handle) {
+    size_t index = (handle >> 24) & 0xff;
+    return handle && index < shards.size() ? shards[index].get() : NULL;
+}
+
+WSClient* WSServer::find(Shard& shard, WSClient::Handle handle) {
+    return shard.clients.get(handle & 0xffffff, handle >> 32);
+}
+
+String WSServer::formatHandle(WSClient::Handle handle) {
+    static const char digits[] = "0123456789abcdef";
+    char text[17];
+    for (int i = 15; i >= 0; i--) {
+        text[i] = digits[handle & 0xf];
+        handle >>= 4;
+    }
+    text[16] = 0;
+    return String(text);
+}
+
+WSClient::Handle WSServer::parseHandle(const String& id) {
+    if (id.length() != 16) return 0;
+    WSClient::Handle handle = 0;
+    for (unsigned int i = 0; i < 16; i++) {
+        char c = id[i];
+        uint8_t digit;
+        if (c >= '0' && c <= '9') {
+            digit = c - '0';
+        } else if (c >= 'a' && c <= 'f') {
+            digit = c - 'a' + 10;
+        } else if (c >= 'A' && c <= 'F') {
+            digit = c - 'A' + 10;
+        } else {
+            return 0;
         }
+        handle = (handle << 4) | digit;
     }
+    return handle;
 }
 
-void WSServer::accept() {
-    if (!server) return;
-    std::shared_ptr<TCPClient> client = server->accept();
-    if (!client) return;
-    for (auto& c : clients) {
-        if (c.remoteIP() == client->remoteIP() && c.remotePort() == client->remotePort()) return;
+void WSServer::broadcast(const String& data, ClientFilter filter) {
+    broadcastMessage(Frame::Text, (const uint8_t*)data.c_str(), data.length(), filter, String());
+}
+
+void WSServer::broadcastBinary(const uint8_t* data, size_t len, ClientFilter filter) {
+    broadcastMessage(Frame::Binary, data, len, filter, String());
+}
+
+// Like broadcast(), but each worker only looks at the subscribers of topic,
+// so the cost follows the number of subscribers, not of connections.
+void WSServer::publish(const String& topic, const String& data) {
+    broadcastMessage(Frame::Text, (const uint8_t*)data.c_str(), data.length(), NULL, topic);
+}
+
+void WSServer::publishBinary(const String& topic, const uint8_t* data, size_t len) {
+    broadcastMessage(Frame::Binary, data, len, NULL, topic);
+}
+
+bool WSServer::subscribe(WSClient::Handle handle, const String& topic) {
+    return updateSubscription(handle, topic, true);
+}
+
+bool WSServer::unsubscribe(WSClient::Handle handle, const String& topic) {
+    return updateSubscription(handle, topic, false);
+}
+
+// Subscriptions belong to the shard that owns the connection; other
+// threads queue the change, in which case true only means it was queued.
+bool WSServer::updateSubscription(WSClient::Handle handle, const String& topic, bool subscribed) {
+    Shard* shard = shardOf(handle);
+    if (!shard || !topic.length()) return false;
+    if (shard != localShard()) {
+        Command command;
+        command.type = subscribed ? Command::Subscribe : Command::Unsubscribe;
+        command.handle = handle;
+        command.topic = topic;
+        post(*shard, command);
+        return true;
+    }
+    if (!find(*shard, handle)) return false;
+    if (subscribed) {
+        subscribe(*shard, handle, topic);
+    } else {
+        unsubscribe(*shard, handle, topic);
+    }
+    return true;
+}
+
+void WSServer::subscribe(Shard& shard, WSClient::Handle handle, const String& topic) {
+    if (!find(shard, handle)) return;
+    uint32_t slot = handle & 0xffffff;
+    if (shard.subscriptions.size() <= slot) shard.subscriptions.resize(slot + 1);
+    std::vector<String>& joined = shard.subscriptions[slot];
+    if (std::find(joined.begin(), joined.end(), topic) != joined.end()) return;
+    joined.push_back(topic);
+    shard.topics[topic].push_back(handle);
+}
+
+void WSServer::unsubscribe(Shard& shard, WSClient::Handle handle, const String& topic) {
+    uint32_t slot = handle & 0xffffff;
+    if (slot >= shard.subscriptions.size()) return;
+    std::vector<String>& joined = shard.subscriptions[slot];
+    auto it = std::find(joined.begin(), joined.end(), topic);
+    if (it == joined.end()) return;
+    *it = joined.back();
+    joined.pop_back();
+
+    auto entry = shard.topics.find(topic);
+    if (entry == shard.topics.end()) return;
+    std::vector<WSClient::Handle>& subscribers = entry->second;
+    auto member = std::find(subscribers.begin(), subscribers.end(), handle);
+    if (member == subscribers.end()) return;
+    if (shard.delivering) {
+        *member = 0;
+        shard.tombstoned.push_back(topic);
+        return;
     }
-    if (!client->connected()) return;
+    *member = subscribers.back();
+    subscribers.pop_back();
+    if (subscribers.empty()) shard.topics.erase(entry);
+}
 
-    std::vector<String> requestHeaders;
-    String line;
-    while (client->available()) {
-        line = client->readLine();
-        line.trim();
-        requestHeaders.push_back(line);
-        if (!line.length()) break;
+// Drops the subscribers unsubscribed while a delivery was under way.
+void WSServer::compact(Shard& shard) {
+    for (const String& topic : shard.tombstoned) {
+        auto entry = shard.topics.find(topic);
+        if (entry == shard.topics.end()) continue;
+        std::vector<WSClient::Handle>& subscribers = entry->second;
+        subscribers.erase(std::remove(subscribers.begin(), subscribers.end(), 0), subscribers.end());
+        if (subscribers.empty()) shard.topics.erase(entry);
     }
+    shard.tombstoned.clear();
+}
+
+// Server frames are not masked, so the frame is the same for every
+// connection: it is encoded once, written as is to the calling worker's
+// clients and shared with every other worker through its inbox.
+void WSServer::broadcastMessage(Frame::Opcode opcode, const uint8_t* data, size_t len, ClientFilter filter, const String& topic) {
+    std::shared_ptr<Encoded> encoded = std::make_shared<Encoded>();
+    Frame::Header header(1, 0, 0, opcode, len);
+    encoded->frame.resize(header.size() + len);
+    encoded->headerSize = header.encode(encoded->frame.data());
+    if (len) memcpy(encoded->frame.data() + encoded->headerSize, data, len);
+    encoded->opcode = opcode;
+    encoded->filter = filter;
+    encoded->topic = topic;
 
-    Crypto::HandshakeServerResult result = Crypto::parseHandshakeRequest(requestHeaders);
-    if (!result.isValid) {
-        client->end();
+    Shard* local = localShard();
+    for (auto& shard : shards) {
+        if (shard.get() == local) {
+            deliver(*shard, encoded);
+            continue;
+        }
+        Command command;
+        command.type = Command::Broadcast;
+        command.encoded = encoded;
+        post(*shard, command);
+    }
+}
+
+// Connections with compression negotiated get the payload compressed with
+// their own context; all others get the shared frame, and slow ones queue
+// it without a copy. Liveness comes from the connection state rather than
+// isConnected(), which costs a syscall; a write to a dead socket fails and
+// marks it for reaping.
+void WSServer::deliver(Shard& shard, const std::shared_ptr<Encoded>& encoded) {
+    if (!encoded->topic.length()) {
+        for (auto& client : shard.clients) deliver(shard, client, encoded);
         return;
     }
+    auto entry = shard.topics.find(encoded->topic);
+    if (entry == shard.topics.end()) return;
+    // A send that overflows closes the connection, and its close callback
+    // may subscribe or unsubscribe. The list is walked by index, so growing
+    // it is safe, and unsubscribing leaves a 0 in place until compact().
+    std::vector<WSClient::Handle>& subscribers = entry->second;
+    shard.delivering++;
+    for (size_t i = 0; i < subscribers.size(); i++) {
+        WSClient* client = subscribers[i] ? find(shard, subscribers[i]) : NULL;
+        if (client) deliver(shard, *client, encoded);
+    }
+    if (!--shard.delivering && !shard.tombstoned.empty()) compact(shard);
+}
 
-    String response = "HTTP/1.1 101 Switching Protocols\r\n";
-    response += "Connection: Upgrade\r\n";
-    response += "Upgrade: websocket\r\n";
-    response += "Sec-WebSocket-Version: 13\r\n";
-    response += "Sec-WebSocket-Version: 13\r\n";
-    response += "Sec-WebSocket-Accept: " + result.key + "\r\n\r\n";
+void WSServer::deliver(Shard& shard, WSClient& client, const std::shared_ptr<Encoded>& encoded) {
+    if (client.state != WSClient::Connected || client.txOpcode) return;
+    if (encoded->filter && !encoded->filter(client)) return;
+    bool sent;
+    if (client.deflate) {
+        size_t len = encoded->frame.size() - encoded->headerSize;
+        sent = client.writeMessage(encoded->opcode, encoded->frame.data() + encoded->headerSize, len);
+    } else {
+        sent = client.writeShared(std::shared_ptr<const std::vector<uint8_t>>(encoded, &encoded->frame));
+    }
+    if (!sent && !isAlive(client)) markDead(shard, client);
+}
 
-    client->write(response);
+// Open as far as we know without a syscall; see TCPClient::isOpen().
+bool WSServer::isAlive(WSClient& client) {
+    return client.state == WSClient::Connected && client.client->isOpen();
+}
 
-    WSClient wsClient(client);
-    wsClient.id = generateId();
+// Queues a dead connection for reap(). Returns false if it already was.
+bool WSServer::markDead(Shard& shard, WSClient& client) {
+    for (auto& dead : shard.dead) {
+        if (dead.handle == client.handle) return false;
+    }
+    Dead dead = {client.handle, client.state == WSClient::Closed && client.closedAt ? client.closedAt : millis()};
+    shard.dead.push_back(dead);
+    return true;
+}
+
+// Releases the connections found dead since the last call. Closed ones
+// still flushing their outbound queue stay on the list until they finish
+// or WS_CLOSE_LINGER runs out.
+void WSServer::reap(Shard& shard) {
+    size_t kept = 0;
+    for (size_t i = 0; i < shard.dead.size(); i++) {
+        Dead dead = shard.dead[i];
+        WSClient* client = find(shard, dead.handle);
+        if (!client) continue;
+        if (client->lingering) client->poll();
+        if (client->lingering) {
+            shard.dead[kept++] = dead;
+            continue;
+        }
+        release(shard, *client, dead.since);
+    }
+    shard.dead.resize(kept);
+    shard.lingering = kept;
+}
+
+// Frees the connection's slot, socket and subscriptions right away, so the
+// slot can be reused by the next connection.
+void WSServer::release(Shard& shard, WSClient& client, uint32_t since) {
+    TCPClient* socket = client.client.get();
+    if (shard.poller) shard.poller->unwatch(socket);
+    client.close(CloseReason_AbnormalClosure);
+    uint32_t slot = client.handle & 0xffffff;
+    while (slot < shard.subscriptions.size() && !shard.subscriptions[slot].empty()) {
+        String topic = shard.subscriptions[slot].back();
+        unsubscribe(shard, client.handle, topic);
+    }
+    shard.clientIndex.erase(socket);
+    shard.undrained.erase(std::remove(shard.undrained.begin(), shard.undrained.end(), socket), shard.undrained.end());
+    {
+#if WS_THREADS
+        std::lock_guard<std::mutex> guard(shard.lock);
+#endif
+        shard.clients.erase(slot);
+    }
+    uint32_t resident = millis() - since;
+    shard.load--;
+    shard.connected--;
+    shard.reaped++;
+    shard.residentTotal += resident;
+    if (resident > shard.residentMax) shard.residentMax = resident;
+}
+
+// Safety net for connections that died without any event reaching us, such
+// as a peer that vanished: asks every socket directly, which costs a call
+// per connection, so it only runs every WS_CLEANUP_INTERVAL ms.
+void WSServer::cleanup(Shard& shard) {
+    for (auto& client : shard.clients) {
+        if (client.isConnected()) continue;
+        if (markDead(shard, client)) shard.swept++;
+    }
+    reap(shard);
+}
+
+void WSServer::resetShards() {
+    shards.clear();
+    uint8_t count = std::max<uint8_t>(workers, 1);
+    for (uint8_t i = 0; i < count; i++) {
+#ifdef ESP32
+        // Even a single loop runs on its own task there, fed by the inbox.
+        shards.emplace_back(new Shard(this, i, WS_WORKER_QUEUE_SIZE));
+#else
+        shards.emplace_back(new Shard(this, i, workers ? WS_WORKER_QUEUE_SIZE : 2));
+#endif
+    }
+}
+
+void WSServer::stopWorkers() {
+    if (!running) return;
+    running = false;
+    for (auto& shard : shards) {
+        if (shard->poller) shard->poller->wake();
+#ifdef ESP32
+        while (shard->handler) delay(1);
+#elif WS_THREADS
+        if (shard->thread.joinable()) shard->thread.join();
+#endif
+    }
+}
+
+// The shard owned by the calling thread: the worker's own shard, or the
+// only shard when run() drives the server. On ESP32 the polling task
+// drives it once begin() has started the task, and owns it like a worker.
+WSServer::Shard* WSServer::localShard() {
+#ifdef ESP32
+    if (!running && !handler) return shards[0].get();
+#else
+    if (!running) return shards[0].get();
+#endif
+    return currentShard && currentShard->server == this ? currentShard : NULL;
+}
+
+WSServer::Shard& WSServer::pickShard() {
+    if (balance == RoundRobin) {
+        Shard& shard = *shards[nextShard % shards.size()];
+        nextShard = (nextShard + 1) % shards.size();
+        return shard;
+    }
+    Shard* best = shards[0].get();
+    for (auto& shard : shards) {
+        if (shard->load < best->load) best = shard.get();
+    }
+    return *best;
+}
+
+// Queues a command for another shard. If its inbox is full, keeps draining
+// our own so two workers posting to each other cannot deadlock.
+void WSServer::post(Shard& shard, Command& command) {
+    Shard* local = currentShard && currentShard->server == this ? currentShard : NULL;
+    while (!shard.inbox.push(command)) {
+        if (local && local != &shard) process(*local);
+        if (shard.poller) shard.poller->wake();
+        yield();
+    }
+    if (shard.poller) shard.poller->wake();
+}
+
+void WSServer::process(Shard& shard) {
+    Command command;
+    while (shard.inbox.pop(command)) {
+        switch (command.type) {
+            case Command::Adopt:
+                adopt(shard, command.client);
+                break;
+            case Command::Broadcast:
+                deliver(shard, command.encoded);
+                break;
+            case Command::Send: {
+                WSClient* client = find(shard, command.handle);
+                if (!client || !isAlive(*client) || client->txOpcode) break;
+                if (!client->writeMessage(command.opcode, command.payload->data(), command.payload->size()) && !isAlive(*client)) markDead(shard, *client);
+                break;
+            }
+            case Command::Close: {
+                WSClient* client = find(shard, command.handle);
+                if (!client) break;
+                client->close(CloseReason_AbnormalClosure);
+                markDead(shard, *client);
+                break;
+            }
+            case Command::Subscribe:
+                subscribe(shard, command.handle, command.topic);
+                break;
+            case Command::Unsubscribe:
+                unsubscribe(shard, command.handle, command.topic);
+                break;
+        }
+    }
+}
+
+// Accepts every pending connection, up to acceptBatch per call so a
+// connection storm cannot starve established clients. Each connection is
+// handed to a shard as a pending handshake; see handshake().
+void WSServer::accept(Shard& acceptor) {
+    if (!server) return;
+    for (uint8_t i = 0; i < acceptBatch && pendingHandshakes < maxPendingHandshakes; i++) {
+        std::shared_ptr<TCPClient> client = server->accept();
+        if (!client) {
+            acceptPending = false;
+            break;
+        }
+        // Gone before we got to it. The listen socket is edge-triggered and
+        // will not report the connections queued behind it again, so go on.
+        if (!client->connected()) {
+            client->end();
+            continue;
+        }
+        pendingHandshakes++;
+        Shard& shard = pickShard();
+        shard.load++;
+        if (&shard == &acceptor) {
+            adopt(shard, client);
+        } else {
+            Command command;
+            command.type = Command::Adopt;
+            command.client = client;
+            post(shard, command);
+        }
+    }
+}
+
+// Advanced on every pass of the accepting shard rather than in accept(),
+// which only runs while connections are arriving, so the rate falls back
+// to 0 once they stop.
+void WSServer::updateAcceptRate() {
+    uint32_t elapsed = millis() - acceptWindowStart;
+    if (elapsed >= 1000) {
+        uint32_t accepted = 0;
+        for (auto& shard : shards) accepted += shard->accepted;
+        acceptRate = (uint64_t)(accepted - acceptWindowAccepted) * 1000 / elapsed;
+        acceptWindowStart += elapsed;
+        acceptWindowAccepted = accepted;
+    }
+}
+
+void WSServer::adopt(Shard& shard, std::shared_ptr<TCPClient> client) {
+    if (shard.poller && !shard.poller->watch(client.get())) shard.poller.reset();
+    shard.handshakeReady = true;
+    Handshake pending;
+    pending.client = client;
+    pending.started = millis();
+    shard.handshakes.push_back(pending);
+}
+
+// Advances every pending handshake with whatever bytes have arrived,
+// without waiting for more.
+void WSServer::handshake(Shard& shard) {
+    for (size_t i = 0; i < shard.handshakes.size(); i++) {
+        int res = readRequest(shard.handshakes[i]);
+        bool timedOut = !res && millis() - shard.handshakes[i].started > handshakeTimeout;
+        if (!res && !timedOut) continue;
+
+        // The connection callback may queue more handshakes, so take this
+        // one out before upgrading it.
+        Handshake pending = shard.handshakes[i];
+        shard.handshakes.erase(shard.handshakes.begin() + i);
+        i--;
+        // A slot is free again: connections left in the listen queue at the
+        // limit get no new event, so look for them on the next pass.
+        pendingHandshakes--;
+        acceptPending = true;
+        if (&shard != shards[0].get() && shards[0]->poller) shards[0]->poller->wake();
+        if (res > 0 && upgrade(shard, pending)) {
+            shard.accepted++;
+        } else {
+            pending.client->end();
+            shard.load--;
+            shard.rejected++;
+            if (timedOut) shard.timedOut++;
+        }
+    }
+}
+
+// Returns 1 once the request headers are complete, 0 while more are
+// expected and -1 if the connection closed or the request is too large.
+int WSServer::readRequest(Handshake& pending) {
+    std::shared_ptr<TCPClient>& client = pending.client;
+    int available = client->available();
+    if (available <= 0) return client->connected() ? 0 : -1;
+
+    uint8_t buffer[256];
+    while (available > 0) {
+        int len = client->read(buffer, std::min<size_t>(available, sizeof(buffer)));
+        if (len <= 0) return -1;
+        available -= len;
+        size_t consumed = 0;
+        if (pending.parser.status() == HandshakeParser::Incomplete) {
+            if (pending.parser.feed(buffer, len, consumed) == HandshakeParser::Invalid) return -1;
+        }
+        if (pending.early.size() + len - consumed > WS_MAX_HANDSHAKE_SIZE) return -1;
+        pending.early.insert(pending.early.end(), buffer + consumed, buffer + len);
+    }
+    return pending.parser.status() == HandshakeParser::Complete ? 1 : 0;
+}
+
+bool WSServer::upgrade(Shard& shard, const Handshake& pending) {
+    const std::shared_ptr<TCPClient>& client = pending.client;
+    // Everything that can turn the connection down is checked before the
+    // 101 goes out: once it has, the peer takes the upgrade as done.
+    if (!pending.parser.isUpgrade()) {
+        refuse(*client, "400 Bad Request");
+        return false;
+    }
+    // Handles keep 24 bits for the slot.
+    if (shard.clients.nextSlot() > 0xffffff) {
+        refuse(*client, "503 Service Unavailable");
+        return false;
+    }
+    // Frames sent right behind the request must fit the receive buffer.
+    if (pending.early.size() > WS_RX_BUFFER_SIZE) {
+        refuse(*client, "400 Bad Request");
+        return false;
+    }
+
+    char accept[SHA1_BASE64_SIZE];
+    pending.parser.acceptKey(accept);
+    char head[160];
+    int headLen = snprintf(head, sizeof(head),
+                           "HTTP/1.1 101 Switching Protocols\r\n"
+                           "Connection: Upgrade\r\n"
+                           "Upgrade: websocket\r\n"
+                           "Sec-WebSocket-Version: 13\r\n"
+                           "Sec-WebSocket-Accept: %s\r\n",
+                           accept);
+
+    String extensions;
+    Deflate::Config config;
+    bool compressed = compressionEnabled && pending.parser.extensions()[0] && Deflate::accept(pending.parser.extensions(), compression, extensions, config);
+    static const char extensionsHeader[] = "Sec-WebSocket-Extensions: ";
+    TCPBuffer response[4] = {{(const uint8_t*)head, (size_t)headLen}};
+    size_t count = 1;
+    if (compressed) {
+        response[count++] = {(const uint8_t*)extensionsHeader, sizeof(extensionsHeader) - 1};
+        response[count++] = {(const uint8_t*)extensions.c_str(), extensions.length()};
+        response[count++] = {(const uint8_t*)"\r\n\r\n", 4};
+    } else {
+        response[count++] = {(const uint8_t*)"\r\n", 2};
+    }
+    size_t total = 0;
+    for (size_t i = 0; i < count; i++) total += response[i].len;
+    if (client->write(response, count) < total) return false;
+
+    uint32_t slot;
+    {
+#if WS_THREADS
+        std::lock_guard<std::mutex> guard(shard.lock);
+#endif
+        slot = shard.clients.emplace(client);
+    }
+    WSClient& wsClient = shard.clients.at(slot);
+    // Frames the client sent right behind its request were read along with
+    // it. The buffer is empty, so they go in with one copy.
+    if (!pending.early.empty()) {
+        size_t len = 0;
+        uint8_t* ptr = wsClient.rxBuffer.writePtr(len);
+        memcpy(ptr, pending.early.data(), pending.early.size());
+        wsClient.rxBuffer.commit(pending.early.size());
+    }
+    if (compressed) wsClient.deflate = std::make_shared<Deflate>(config);
+    wsClient.handle = ((uint64_t)shard.clients.generation(slot) << 32) | ((uint64_t)shard.index << 24) | slot;
+    wsClient.id = formatHandle(wsClient.handle);
     wsClient.setUseMask(false);
+    wsClient.setWatermarks(highWatermark, lowWatermark);
+    wsClient.setMaxQueuedBytes(maxQueued, overflowPolicy);
+    shard.connected++;
+    shard.clientIndex[client.get()] = slot;
+    if (!wsClient.rxBuffer.empty()) shard.undrained.push_back(client.get());
+    // The connection is registered first, so the callback can already
+    // reach it by handle, and the reference it gets stays valid.
     if (callback) callback(wsClient);
-    clients.push_back(wsClient);
+    return true;
+}
+
+// Turns a handshake down with an HTTP error and no body.
+void WSServer::refuse(TCPClient& client, const char* status) {
+    String response = String("HTTP/1.1 ") + status + "\r\nConnection: close\r\nContent-Length: 0\r\n\r\n";
+    client.write(response);
 }
 
-String WSServer::generateId() {
-    String id = "";
-    for (int i = 0; i < 16; i++) {
-        id += String(random(0, 16), HEX);
+// Services only the clients the backend reports as ready, plus those
+// that still had unread data after the last pass.
+void WSServer::react(Shard& shard, uint32_t timeout) {
+    bool acceptor = shard.index == 0;
+    // At the handshake limit, pending connections wait for a slot to free up
+    // rather than keep the loop spinning.
+    bool canAccept = acceptor && acceptPending && pendingHandshakes < maxPendingHandshakes;
+    if (canAccept || !shard.undrained.empty() || !shard.inbox.empty()) timeout = 0;
+    if (!shard.handshakes.empty()) {
+        uint32_t waited = millis() - shard.handshakes[0].started;
+        // handshake() expires it once strictly past the timeout.
+        timeout = std::min(timeout, waited <= handshakeTimeout ? handshakeTimeout - waited + 1 : 0);
+    }
+    // Lingering connections need polling to notice WS_CLOSE_LINGER expire.
+    if (!shard.dead.empty()) timeout = std::min<uint32_t>(timeout, 10);
+
+    if (shard.ready.size() < 64) shard.ready.resize(64);
+    bool acceptable = false;
+    int count = shard.poller->wait(shard.ready.data(), shard.ready.size(), timeout, acceptable);
+    if (acceptable) acceptPending = true;
+    for (int i = 0; i < count; i++) shard.undrained.push_back(shard.ready[i]);
+
+    size_t serviced = shard.undrained.size();
+    for (size_t i = 0; i < serviced; i++) {
+        auto it = shard.clientIndex.find(shard.undrained[i]);
+        if (it == shard.clientIndex.end()) {
+            shard.handshakeReady = true;
+            continue;
+        }
+        WSClient& client = shard.clients.at(it->second);
+        client.poll();
+        if (!isAlive(client)) {
+            markDead(shard, client);
+            continue;
+        }
+        // Edge-triggered readiness will not fire again for data we left behind.
+        if (client.client->available() > 0) shard.undrained.push_back(shard.undrained[i]);
+    }
+    shard.undrained.erase(shard.undrained.begin(), shard.undrained.begin() + serviced);
+
+    process(shard);
+    if (acceptor && acceptPending) accept(shard);
+    if (shard.handshakeReady || (!shard.handshakes.empty() && millis() - shard.handshakes[0].started > handshakeTimeout)) {
+        shard.handshakeReady = false;
+        handshake(shard);
     }
-    return id;
 }
 
-void WSServer::run() {
-    poll();
-    if (millis() - lastAccept > 1000) {
-        lastAccept = millis();
-        accept();
+// One pass of a shard's event loop. Shard 0 also accepts new connections.
+void WSServer::serve(Shard& shard, uint32_t timeout) {
+    if (shard.poller) {
+        react(shard, timeout);
+    } else {
+        process(shard);
+        for (auto& client : shard.clients) {
+            client.poll();
+            if (!isAlive(client)) markDead(shard, client);
+        }
+        if (shard.index == 0) accept(shard);
+        handshake(shard);
+    }
+    if (shard.index == 0) updateAcceptRate();
+    if (millis() - shard.lastCleanup > WS_CLEANUP_INTERVAL) {
+        shard.lastCleanup = millis();
+        cleanup(shard);
+    } else if (!shard.dead.empty()) {
+        reap(shard);
     }
-    if (millis() - lastCleanup > 5000) {
-        lastCleanup = millis();
-        cleanup();
+}
+
+void WSServer::work(Shard& shard) {
+    currentShard = &shard;
+    while (running) {
+        serve(shard, 100);
+        if (!shard.poller) delay(1);
     }
+    currentShard = NULL;
+}
+
+// Waits up to timeout ms for activity when the backend supports readiness
+// notification; otherwise polls every client and returns immediately.
+// With workers, the event loops run on their own and this does nothing.
+// Neither does it on ESP32 outside the polling task, which calls it.
+void WSServer::run(uint32_t timeout) {
+    if (running) return;
+#ifdef ESP32
+    if (handler && currentShard != shards[0].get()) return;
+#endif
+    serve(*shards[0], timeout);
 }
 
 #ifdef ESP32
@@ -135,7 +909,17 @@ void WSServer::pollingTask(void* ptr) {
     while (true) {
         delay(2);
         if (!server) vTaskDelete(NULL);
+        // The task owns shard 0 while no workers run; other tasks reach
+        // it through its inbox.
+        currentShard = server->running ? NULL : server->shards[0].get();
         server->run();
     }
 }
-#endif
\ No newline at end of file
+
+void WSServer::workerTask(void* ptr) {
+    Shard* shard = (Shard*)ptr;
+    shard->server->work(*shard);
+    shard->handler = NULL;
+    vTaskDelete(NULL);
+}
+#endif
@@ -1,15 +1,106 @@
 #ifndef WS_SERVER_H
 #define WS_SERVER_H
 
+#include <algorithm>
+#include <atomic>
 #include <functional>
 #include <memory>
+#include <unordered_map>
 
+#if defined(ESP32) || defined(ESP8266)
 #include "TCPWiFiServer.h"
+#elif defined(__linux__)
+#include "TCPEpollServer.h"
+#else
+#include "TCPPosixServer.h"
+#endif
 #include "WSClient.h"
+#include "utilities/AtomicQueue.h"
+#include "utilities/HandshakeParser.h"
+#include "utilities/SlotMap.h"
+
+// Worker event loops need threads; ESP8266 always runs a single loop.
+#ifndef WS_THREADS
+#ifdef ESP8266
+#define WS_THREADS 0
+#else
+#define WS_THREADS 1
+#endif
+#endif
+
+#if WS_THREADS
+#include <mutex>
+#ifndef ESP32
+#include <thread>
+#endif
+#endif
+
+// Commands (new connections, broadcasts, closes) each worker can have
+// queued from other threads before senders have to wait.
+#ifndef WS_WORKER_QUEUE_SIZE
+#if defined(ESP32) || defined(ESP8266)
+#define WS_WORKER_QUEUE_SIZE 64
+#else
+#define WS_WORKER_QUEUE_SIZE 1024
+#endif
+#endif
+
+// Most connections accepted by one run() pass.
+#ifndef WS_ACCEPT_BATCH
+#define WS_ACCEPT_BATCH 16
+#endif
+
+// Dead connections are released as soon as a read, write, hangup or close
+// frame reveals them. A sweep every WS_CLEANUP_INTERVAL ms also asks each
+// socket directly, for deaths that produce no event.
+#ifndef WS_CLEANUP_INTERVAL
+#define WS_CLEANUP_INTERVAL 5000
+#endif
+
+// Upgrade requests are parsed as their bytes arrive. A connection is
+// dropped if its request takes longer than WS_HANDSHAKE_TIMEOUT ms (see
+// WSClient.h) or grows past the header limits in HandshakeParser.h. Once
+// WS_MAX_PENDING_HANDSHAKES are in flight, new connections wait in the
+// listen queue.
+#ifndef WS_MAX_PENDING_HANDSHAKES
+#if defined(ESP32) || defined(ESP8266)
+#define WS_MAX_PENDING_HANDSHAKES 4
+#else
+#define WS_MAX_PENDING_HANDSHAKES 64
+#endif
+#endif
 
 class WSServer {
    public:
     using WSCallback = std::function<void(WSClient&)>;
+    // Chooses which connections a broadcast goes to. Runs on the thread
+    // that owns each connection.
+    using ClientFilter = std::function<bool(WSClient&)>;
+
+    // How setWorkers() assigns new connections to workers.
+    enum Balance {
+        RoundRobin,
+        LeastLoaded
+    };
+
+    struct AcceptStats {
+        uint32_t accepted = 0;    // connections upgraded since begin()
+        uint32_t rejected = 0;    // connections closed during the handshake
+        uint32_t timedOut = 0;    // of those, how many hit the handshake timeout
+        uint32_t pending = 0;     // handshakes in flight
+        uint32_t acceptRate = 0;  // connections accepted per second, over the last second
+        int backlog = -1;         // connections waiting in the listen queue, -1 if unknown
+    };
+
+    // Residency is the time from a connection being known dead (closed, or
+    // found dead by a read, write or the sweep) to its slot being freed.
+    struct ReapStats {
+        uint32_t reaped = 0;          // connections released since begin()
+        uint32_t swept = 0;           // of those, how many only the periodic sweep found
+        uint32_t lingering = 0;       // closed connections still flushing
+        uint32_t avgResidentMs = 0;
+        uint32_t maxResidentMs = 0;
+    };
 
     WSServer(uint16_t port = 80, uint8_t maxClients = 4);
     WSServer(std::shared_ptr<TCPServer> server);
@@ -17,30 +108,200 @@ class WSServer {
     void begin();
     void poll();
     void end();
-    void run();
+    void run(uint32_t timeout = 0);
     void close(String id);
+    bool close(WSClient::Handle handle);
     bool hasClients();
     bool hasClient(String id);
-    std::vector<WSClient>& getClients();
+    bool hasClient(WSClient::Handle handle);
+    WSClient* getClient(WSClient::Handle handle);
+    // Only valid on the thread that calls run(), or on a worker for its own
+    // connections; empty anywhere else.
+    SlotMap<WSClient>& getClients();
+    bool send(WSClient::Handle handle, const String& data);
+    bool sendBinary(WSClient::Handle handle, const uint8_t* data, size_t len);
+    void broadcast(const String& data, ClientFilter filter = NULL);
+    void broadcastBinary(const uint8_t* data, size_t len, ClientFilter filter = NULL);
+    bool subscribe(WSClient::Handle handle, const String& topic);
+    bool unsubscribe(WSClient::Handle handle, const String& topic);
+    void publish(const String& topic, const String& data);
+    void publishBinary(const String& topic, const uint8_t* data, size_t len);
     void onConnection(WSCallback callback);
+    void setCompression(const Deflate::Options& options = Deflate::Options());
+    void setAcceptBatch(uint8_t batch);
+    void setHandshakeTimeout(uint32_t timeout);
+    void setMaxPendingHandshakes(uint16_t count);
+    void setWorkers(uint8_t count, Balance balance = LeastLoaded);
+    void setWatermarks(size_t high, size_t low);
+    void setMaxQueuedBytes(size_t limit, WSClient::OverflowPolicy policy = WSClient::DropConnection);
+    const AcceptStats& getAcceptStats();
+    const ReapStats& getReapStats();
 
     WSServer(const WSServer&) = delete;
     WSServer(WSServer&&) = delete;
     WSServer& operator=(const WSServer&) = delete;
 
    private:
+    struct Handshake {
+        std::shared_ptr<TCPClient> client;
+        HandshakeParser parser;
+        std::vector<uint8_t> early;  // frames sent right behind the request
+        uint32_t started;
+    };
+
+    // A message encoded once as an unmasked frame. Every connection it is
+    // broadcast to, on any shard, is sent the same bytes.
+    struct Encoded {
+        std::vector<uint8_t> frame;
+        size_t headerSize;
+        Frame::Opcode opcode;
+        ClientFilter filter;
+        String topic;  // only its subscribers get it, when set
+    };
+
+    // FNV-1a, since Arduino's String has no std::hash.
+    struct TopicHash {
+        size_t operator()(const String& topic) const {
+            uint32_t hash = 2166136261u;
+            for (unsigned int i = 0; i < topic.length(); i++) hash = (hash ^ (uint8_t)topic[i]) * 16777619u;
+            return hash;
+        }
+    };
+
+    // A connection found dead, and since when.
+    struct Dead {
+        WSClient::Handle handle;
+        uint32_t since;
+    };
+
+    // Work handed to a shard by other threads.
+    struct Command {
+        enum Type {
+            Adopt,
+            Broadcast,
+            Send,
+            Close,
+            Subscribe,
+            Unsubscribe
+        };
+        Type type = Broadcast;
+        std::shared_ptr<TCPClient> client;
+        std::shared_ptr<std::vector<uint8_t>> payload;
+        std::shared_ptr<Encoded> encoded;
+        Frame::Opcode opcode = Frame::Text;
+        WSClient::Handle handle = 0;
+        String topic;
+    };
+
+    // One event loop and the connections it owns. Only the shard's own
+    // thread touches its clients; everyone else goes through the inbox.
+    struct Shard {
+        Shard(WSServer* server, uint8_t index, size_t queueSize)
+            : server(server), index(index), inbox(queueSize), load(0), connected(0), accepted(0), rejected(0), timedOut(0), reaped(0), swept(0), lingering(0), residentTotal(0), residentMax(0) {}
+
+        WSServer* server;
+        uint8_t index;
+        SlotMap<WSClient> clients;  // slot numbers and generations form the handles
+        std::vector<Handshake> handshakes;
+        std::shared_ptr<TCPPoller> poller;
+        bool handshakeReady = false;
+        std::vector<TCPClient*> ready;
+        std::vector<TCPClient*> undrained;
+        std::unordered_map<TCPClient*, uint32_t> clientIndex;  // socket to slot
+        // Subscribers of each topic, and the topics of each slot so a
+        // closed connection can be dropped from them.
+        std::unordered_map<String, std::vector<WSClient::Handle>, TopicHash> topics;
+        std::vector<std::vector<String>> subscriptions;
+        // While deliver() walks a subscriber list, unsubscribing leaves a 0
+        // in its place; the lists named here are compacted afterwards.
+        uint32_t delivering = 0;
+        std::vector<String> tombstoned;
+        std::vector<Dead> dead;
+        uint32_t lastCleanup = 0;
+        AtomicQueue<Command> inbox;
+        std::atomic<uint32_t> load;  // connections owned, including pending handshakes
+        std::atomic<uint32_t> connected;
+        std::atomic<uint32_t> accepted;
+        std::atomic<uint32_t> rejected;
+        std::atomic<uint32_t> timedOut;
+        std::atomic<uint32_t> reaped;
+        std::atomic<uint32_t> swept;
+        std::atomic<uint32_t> lingering;
+        std::atomic<uint32_t> residentTotal;  // ms, summed over reaped
+        std::atomic<uint32_t> residentMax;
+#if WS_THREADS
+        std::mutex lock;  // held while clients change, for hasClient() on other threads
+#ifdef ESP32
+        volatile TaskHandle_t handler = NULL;
+#else
+        std::thread thread;
+#endif
+#endif
+    };
+
     std::shared_ptr<TCPServer> server;
-    std::vector<WSClient> clients;
+    std::vector<std::unique_ptr<Shard>> shards;
     WSCallback callback = NULL;
-    uint32_t lastAccept = 0;
-    uint32_t lastCleanup = 0;
-    String generateId();
-    void accept();
-    void cleanup();
+    bool compressionEnabled = false;
+    Deflate::Options compression;
+    uint8_t acceptBatch = WS_ACCEPT_BATCH;
+    uint32_t handshakeTimeout = WS_HANDSHAKE_TIMEOUT;
+    uint16_t maxPendingHandshakes = WS_MAX_PENDING_HANDSHAKES;
+    uint8_t workers = 0;
+    Balance balance = LeastLoaded;
+    size_t highWatermark = WS_TX_HIGH_WATERMARK;
+    size_t lowWatermark = WS_TX_LOW_WATERMARK;
+    size_t maxQueued = WS_TX_QUEUE_LIMIT;
+    WSClient::OverflowPolicy overflowPolicy = WSClient::DropConnection;
+    uint8_t nextShard = 0;
+    std::atomic<bool> running;
+    std::atomic<uint32_t> pendingHandshakes;
+    std::atomic<uint32_t> acceptRate;
+    AcceptStats acceptStats;
+    ReapStats reapStats;
+    uint32_t acceptWindowStart = 0;
+    uint32_t acceptWindowAccepted = 0;
+    std::atomic<bool> acceptPending;
+    static thread_local Shard* currentShard;
+
+    static String formatHandle(WSClient::Handle handle);
+    static WSClient::Handle parseHandle(const String& id);
+    Shard* shardOf(WSClient::Handle handle);
+    WSClient* find(Shard& shard, WSClient::Handle handle);
+    bool sendMessage(WSClient::Handle handle, Frame::Opcode opcode, const uint8_t* data, size_t len);
+    Shard* localShard();
+    Shard& pickShard();
+    void resetShards();
+    void stopWorkers();
+    void work(Shard& shard);
+    void serve(Shard& shard, uint32_t timeout);
+    void react(Shard& shard, uint32_t timeout);
+    void post(Shard& shard, Command& command);
+    void process(Shard& shard);
+    void broadcastMessage(Frame::Opcode opcode, const uint8_t* data, size_t len, ClientFilter filter, const String& topic);
+    void deliver(Shard& shard, const std::shared_ptr<Encoded>& encoded);
+    void deliver(Shard& shard, WSClient& client, const std::shared_ptr<Encoded>& encoded);
+    bool updateSubscription(WSClient::Handle handle, const String& topic, bool subscribed);
+    void subscribe(Shard& shard, WSClient::Handle handle, const String& topic);
+    void unsubscribe(Shard& shard, WSClient::Handle handle, const String& topic);
+    void accept(Shard& acceptor);
+    void updateAcceptRate();
+    void adopt(Shard& shard, std::shared_ptr<TCPClient> client);
+    void handshake(Shard& shard);
+    int readRequest(Handshake& pending);
+    bool upgrade(Shard& shard, const Handshake& pending);
+    void compact(Shard& shard);
+    static void refuse(TCPClient& client, const char* status);
+    static bool isAlive(WSClient& client);
+    bool markDead(Shard& shard, WSClient& client);
+    void reap(Shard& shard);
+    void release(Shard& shard, WSClient& client, uint32_t since);
+    void cleanup(Shard& shard);
 #ifdef ESP32
     TaskHandle_t handler = NULL;
     static void pollingTask(void* ptr);
+    static void workerTask(void* ptr);
 #endif
 };
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,93 @@
+#ifndef ATOMIC_QUEUE_H
+#define ATOMIC_QUEUE_H
+
+#include <atomic>
+#include <memory>
+
+#include "Arduino.h"
+
+// Bounded lock-free queue for any number of producers and consumers
+// (Vyukov's sequence-numbered ring). Each cell carries a sequence number
+// that tells producers and consumers whose turn it is, so push() and pop()
+// need one CAS and never block. Capacity is rounded up to a power of two.
+template <typename T>
+class AtomicQueue {
+  public:
+    AtomicQueue(size_t capacity = 1024) {
+      size_t size = 2;
+      while (size < capacity) size <<= 1;
+      cells.reset(new Cell[size]);
+      mask = size - 1;
+      for (size_t i = 0; i < size; i++) cells[i].sequence.store(i, std::memory_order_relaxed);
+      head.store(0, std::memory_order_relaxed);
+      tail.store(0, std::memory_order_relaxed);
+    }
+
+    AtomicQueue(const AtomicQueue &) = delete;
+    AtomicQueue &operator=(const AtomicQueue &) = delete;
+
+    // Returns false, leaving item untouched, when the queue is full.
+    bool push(T &item) {
+      size_t pos = tail.load(std::memory_order_relaxed);
+      Cell *cell;
+      while (true) {
+        cell = &cells[pos & mask];
+        size_t seq = cell->sequence.load(std::memory_order_acquire);
+        intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+        if (diff == 0) {
+          if (tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break;
+        } else if (diff < 0) {
+          return false;
+        } else {
+          pos = tail.load(std::memory_order_relaxed);
+        }
+      }
+      cell->item = std::move(item);
+      cell->sequence.store(pos + 1, std::memory_order_release);
+      return true;
+    }
+
+    bool pop(T &item) {
+      size_t pos = head.load(std::memory_order_relaxed);
+      Cell *cell;
+      while (true) {
+        cell = &cells[pos & mask];
+        size_t seq = cell->sequence.load(std::memory_order_acquire);
+        intptr_t diff = (intptr_t)seq - (intptr_t)(pos + 1);
+        if (diff == 0) {
+          if (head.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break;
+        } else if (diff < 0) {
+          return false;
+        } else {
+          pos = head.load(std::memory_order_relaxed);
+        }
+      }
+      item = std::move(cell->item);
+      cell->item = T();
+      cell->sequence.store(pos + mask + 1, std::memory_order_release);
+      return true;
+    }
+
+    bool empty() const {
+      return head.load(std::memory_order_acquire) == tail.load(std::memory_order_acquire);
+    }
+
+  private:
+    struct Cell {
+      std::atomic<size_t> sequence;
+      T item;
+    };
+
+    std::unique_ptr<Cell[]> cells;
+    size_t mask;
+    // Padded onto separate cache lines so producers and the consumer do not
+    // invalidate each other's line on every operation. Padding rather than
+    // alignas(64): plain new ignores over-alignment before C++17.
+    char padHead[64];
+    std::atomic<size_t> head;
+    char padTail[64 - sizeof(std::atomic<size_t>)];
+    std::atomic<size_t> tail;
+    char padEnd[64 - sizeof(std::atomic<size_t>)];
+};
+
+#endif
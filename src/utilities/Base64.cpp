@@ -1,76 +1,345 @@
 #include "Base64.h"
 
-const String Base64::base64_chars = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define BASE64_X86
+#include <immintrin.h>
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#define BASE64_NEON
+#include <arm_neon.h>
+#endif
+
+static const char alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+// Sextet value of every byte, 255 for bytes outside the alphabet.
+static const uint8_t decodeTable[256] = {
+  255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255,
+  255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255,
+  255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255,  62, 255, 255, 255,  63,
+   52,  53,  54,  55,  56,  57,  58,  59,  60,  61, 255, 255, 255, 255, 255, 255,
+  255,   0,   1,   2,   3,   4,   5,   6,   7,   8,   9,  10,  11,  12,  13,  14,
+   15,  16,  17,  18,  19,  20,  21,  22,  23,  24,  25, 255, 255, 255, 255, 255,
+  255,  26,  27,  28,  29,  30,  31,  32,  33,  34,  35,  36,  37,  38,  39,  40,
+   41,  42,  43,  44,  45,  46,  47,  48,  49,  50,  51, 255, 255, 255, 255, 255,
+  255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255,
+  255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255,
+  255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255,
+  255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255,
+  255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255,
+  255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255,
+  255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255,
+  255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255
+};
+
+// Decodes whole quads. False at the first byte outside the alphabet.
+static bool decodeQuads(const uint8_t *in, size_t quads, uint8_t *out) {
+  for (; quads; quads--, in += 4, out += 3) {
+    uint32_t a = decodeTable[in[0]];
+    uint32_t b = decodeTable[in[1]];
+    uint32_t c = decodeTable[in[2]];
+    uint32_t d = decodeTable[in[3]];
+    if ((a | b | c | d) & 0x80) return false;
+    uint32_t v = (a << 18) | (b << 12) | (c << 6) | d;
+    out[0] = v >> 16;
+    out[1] = v >> 8;
+    out[2] = v;
+  }
+  return true;
+}
+
+#ifdef BASE64_X86
+// The vector kernels work on 12-byte groups per 128-bit lane, following
+// Wojciech Muła's SSE base64 codec. Each returns how much it processed and
+// leaves the rest to the scalar code.
+
+// Spreads 12 bytes into 16 sextets and maps them to the alphabet.
+__attribute__((target("ssse3"))) static size_t encodeSsse3(const uint8_t *data, size_t len, char *out) {
+  const __m128i spread = _mm_setr_epi8(1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10);
+  const __m128i shifts = _mm_setr_epi8('a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '+' - 62, '/' - 63, 'A', 0, 0);
+  size_t i = 0;
+  for (; i + 16 <= len; i += 12, out += 16) {
+    __m128i in = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(data + i)), spread);
+    __m128i ac = _mm_mulhi_epu16(_mm_and_si128(in, _mm_set1_epi32(0x0fc0fc00)), _mm_set1_epi32(0x04000040));
+    __m128i bd = _mm_mullo_epi16(_mm_and_si128(in, _mm_set1_epi32(0x003f03f0)), _mm_set1_epi32(0x01000010));
+    __m128i sextets = _mm_or_si128(ac, bd);
+    __m128i range = _mm_subs_epu8(sextets, _mm_set1_epi8(51));
+    range = _mm_or_si128(range, _mm_and_si128(_mm_cmpgt_epi8(_mm_set1_epi8(26), sextets), _mm_set1_epi8(13)));
+    __m128i chars = _mm_add_epi8(_mm_shuffle_epi8(shifts, range), sextets);
+    _mm_storeu_si128((__m128i *)out, chars);
+  }
+  return i;
+}
+
+__attribute__((target("avx2"))) static size_t encodeAvx2(const uint8_t *data, size_t len, char *out) {
+  const __m256i spread = _mm256_setr_epi8(1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10, 1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10);
+  const __m256i shifts = _mm256_broadcastsi128_si256(_mm_setr_epi8('a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '+' - 62, '/' - 63, 'A', 0, 0));
+  size_t i = 0;
+  for (; i + 28 <= len; i += 24, out += 32) {
+    __m256i in = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_loadu_si128((const __m128i *)(data + i))), _mm_loadu_si128((const __m128i *)(data + i + 12)), 1);
+    in = _mm256_shuffle_epi8(in, spread);
+    __m256i ac = _mm256_mulhi_epu16(_mm256_and_si256(in, _mm256_set1_epi32(0x0fc0fc00)), _mm256_set1_epi32(0x04000040));
+    __m256i bd = _mm256_mullo_epi16(_mm256_and_si256(in, _mm256_set1_epi32(0x003f03f0)), _mm256_set1_epi32(0x01000010));
+    __m256i sextets = _mm256_or_si256(ac, bd);
+    __m256i range = _mm256_subs_epu8(sextets, _mm256_set1_epi8(51));
+    range = _mm256_or_si256(range, _mm256_and_si256(_mm256_cmpgt_epi8(_mm256_set1_epi8(26), sextets), _mm256_set1_epi8(13)));
+    __m256i chars = _mm256_add_epi8(_mm256_shuffle_epi8(shifts, range), sextets);
+    _mm256_storeu_si256((__m256i *)out, chars);
+  }
+  return i;
+}
+
+// Maps 16 characters to sextets by range, clearing valid when one is
+// outside the alphabet, then packs them into 12 bytes.
+__attribute__((target("ssse3"))) static size_t decodeSsse3(const uint8_t *in, size_t quads, uint8_t *out, size_t outLen) {
+  const __m128i pack = _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1);
+  size_t q = 0;
+  for (; q + 4 <= quads && q * 3 + 16 <= outLen; q += 4) {
+    __m128i c = _mm_loadu_si128((const __m128i *)(in + q * 4));
+    __m128i upper = _mm_and_si128(_mm_cmpgt_epi8(c, _mm_set1_epi8('A' - 1)), _mm_cmpgt_epi8(_mm_set1_epi8('Z' + 1), c));
+    __m128i lower = _mm_and_si128(_mm_cmpgt_epi8(c, _mm_set1_epi8('a' - 1)), _mm_cmpgt_epi8(_mm_set1_epi8('z' + 1), c));
+    __m128i digit = _mm_and_si128(_mm_cmpgt_epi8(c, _mm_set1_epi8('0' - 1)), _mm_cmpgt_epi8(_mm_set1_epi8('9' + 1), c));
+    __m128i plus = _mm_cmpeq_epi8(c, _mm_set1_epi8('+'));
+    __m128i slash = _mm_cmpeq_epi8(c, _mm_set1_epi8('/'));
+    __m128i valid = _mm_or_si128(_mm_or_si128(_mm_or_si128(upper, lower), _mm_or_si128(digit, plus)), slash);
+    if (_mm_movemask_epi8(valid) != 0xffff) break;
+    __m128i shift = _mm_or_si128(_mm_and_si128(upper, _mm_set1_epi8(-65)), _mm_and_si128(lower, _mm_set1_epi8(-71)));
+    shift = _mm_or_si128(shift, _mm_and_si128(digit, _mm_set1_epi8(4)));
+    shift = _mm_or_si128(shift, _mm_or_si128(_mm_and_si128(plus, _mm_set1_epi8(19)), _mm_and_si128(slash, _mm_set1_epi8(16))));
+    __m128i sextets = _mm_add_epi8(c, shift);
+    __m128i merged = _mm_madd_epi16(_mm_maddubs_epi16(sextets, _mm_set1_epi32(0x01400140)), _mm_set1_epi32(0x00011000));
+    _mm_storeu_si128((__m128i *)(out + q * 3), _mm_shuffle_epi8(merged, pack));
+  }
+  return q;
+}
+
+__attribute__((target("avx2"))) static size_t decodeAvx2(const uint8_t *in, size_t quads, uint8_t *out, size_t outLen) {
+  const __m256i pack = _mm256_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1, 2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1);
+  size_t q = 0;
+  for (; q + 8 <= quads && q * 3 + 28 <= outLen; q += 8) {
+    __m256i c = _mm256_loadu_si256((const __m256i *)(in + q * 4));
+    __m256i upper = _mm256_and_si256(_mm256_cmpgt_epi8(c, _mm256_set1_epi8('A' - 1)), _mm256_cmpgt_epi8(_mm256_set1_epi8('Z' + 1), c));
+    __m256i lower = _mm256_and_si256(_mm256_cmpgt_epi8(c, _mm256_set1_epi8('a' - 1)), _mm256_cmpgt_epi8(_mm256_set1_epi8('z' + 1), c));
+    __m256i digit = _mm256_and_si256(_mm256_cmpgt_epi8(c, _mm256_set1_epi8('0' - 1)), _mm256_cmpgt_epi8(_mm256_set1_epi8('9' + 1), c));
+    __m256i plus = _mm256_cmpeq_epi8(c, _mm256_set1_epi8('+'));
+    __m256i slash = _mm256_cmpeq_epi8(c, _mm256_set1_epi8('/'));
+    __m256i valid = _mm256_or_si256(_mm256_or_si256(_mm256_or_si256(upper, lower), _mm256_or_si256(digit, plus)), slash);
+    if (_mm256_movemask_epi8(valid) != -1) break;
+    __m256i shift = _mm256_or_si256(_mm256_and_si256(upper, _mm256_set1_epi8(-65)), _mm256_and_si256(lower, _mm256_set1_epi8(-71)));
+    shift = _mm256_or_si256(shift, _mm256_and_si256(digit, _mm256_set1_epi8(4)));
+    shift = _mm256_or_si256(shift, _mm256_or_si256(_mm256_and_si256(plus, _mm256_set1_epi8(19)), _mm256_and_si256(slash, _mm256_set1_epi8(16))));
+    __m256i sextets = _mm256_add_epi8(c, shift);
+    __m256i merged = _mm256_madd_epi16(_mm256_maddubs_epi16(sextets, _mm256_set1_epi32(0x01400140)), _mm256_set1_epi32(0x00011000));
+    merged = _mm256_shuffle_epi8(merged, pack);
+    _mm_storeu_si128((__m128i *)(out + q * 3), _mm256_castsi256_si128(merged));
+    _mm_storeu_si128((__m128i *)(out + q * 3 + 12), _mm256_extracti128_si256(merged, 1));
+  }
+  return q;
+}
+
+static bool hasSsse3() {
+  static const bool supported = __builtin_cpu_supports("ssse3");
+  return supported;
+}
+
+static bool hasAvx2() {
+  static const bool supported = __builtin_cpu_supports("avx2");
+  return supported;
+}
+
+static size_t encodeVector(const uint8_t *data, size_t len, char *out) {
+  size_t i = 0;
+  if (hasAvx2()) i = encodeAvx2(data, len, out);
+  if (hasSsse3()) i += encodeSsse3(data + i, len - i, out + i / 3 * 4);
+  return i;
+}
+
+static size_t decodeVector(const uint8_t *in, size_t quads, uint8_t *out, size_t outLen) {
+  size_t q = 0;
+  if (hasAvx2()) q = decodeAvx2(in, quads, out, outLen);
+  if (hasSsse3()) q += decodeSsse3(in + q * 4, quads - q, out + q * 3, outLen - q * 3);
+  return q;
+}
+#endif
+
+#ifdef BASE64_NEON
+// 48 bytes to 64 characters per step, de-interleaved by vld3/vst4.
+static size_t encodeVector(const uint8_t *data, size_t len, char *out) {
+  uint8x16x4_t table;
+  for (int k = 0; k < 4; k++) table.val[k] = vld1q_u8((const uint8_t *)alphabet + k * 16);
+  const uint8x16_t mask = vdupq_n_u8(0x3f);
+  size_t i = 0;
+  for (; i + 48 <= len; i += 48, out += 64) {
+    uint8x16x3_t in = vld3q_u8(data + i);
+    uint8x16x4_t sextets;
+    sextets.val[0] = vshrq_n_u8(in.val[0], 2);
+    sextets.val[1] = vandq_u8(vorrq_u8(vshlq_n_u8(in.val[0], 4), vshrq_n_u8(in.val[1], 4)), mask);
+    sextets.val[2] = vandq_u8(vorrq_u8(vshlq_n_u8(in.val[1], 2), vshrq_n_u8(in.val[2], 6)), mask);
+    sextets.val[3] = vandq_u8(in.val[2], mask);
+    uint8x16x4_t chars;
+    for (int k = 0; k < 4; k++) chars.val[k] = vqtbl4q_u8(table, sextets.val[k]);
+    vst4q_u8((uint8_t *)out, chars);
+  }
+  return i;
+}
+
+// 64 characters to 48 bytes per step. The table lookup yields 0 for
+// characters past 127, so those are caught by OR-ing in the input.
+static size_t decodeVector(const uint8_t *in, size_t quads, uint8_t *out, size_t outLen) {
+  uint8x16x4_t low, high;
+  for (int k = 0; k < 4; k++) {
+    low.val[k] = vld1q_u8(decodeTable + k * 16);
+    high.val[k] = vld1q_u8(decodeTable + 64 + k * 16);
+  }
+  const uint8x16_t offset = vdupq_n_u8(0x40);
+  size_t q = 0;
+  for (; q + 16 <= quads; q += 16) {
+    uint8x16x4_t c = vld4q_u8(in + q * 4);
+    uint8x16x4_t sextets;
+    uint8x16_t bad = vdupq_n_u8(0);
+    for (int k = 0; k < 4; k++) {
+      sextets.val[k] = vqtbx4q_u8(vqtbl4q_u8(low, c.val[k]), high, veorq_u8(c.val[k], offset));
+      bad = vorrq_u8(bad, vorrq_u8(sextets.val[k], c.val[k]));
+    }
+    if (vmaxvq_u8(bad) & 0x80) break;
+    uint8x16x3_t bytes;
+    bytes.val[0] = vorrq_u8(vshlq_n_u8(sextets.val[0], 2), vshrq_n_u8(sextets.val[1], 4));
+    bytes.val[1] = vorrq_u8(vshlq_n_u8(sextets.val[1], 4), vshrq_n_u8(sextets.val[2], 2));
+    bytes.val[2] = vorrq_u8(vshlq_n_u8(sextets.val[2], 6), sextets.val[3]);
+    vst3q_u8(out + q * 3, bytes);
+  }
+  (void)outLen;
+  return q;
+}
+#endif
+
+// Shared by decode() and decodePortable(); vector says whether the vector
+// kernels may take the bulk of the input.
+static bool decodeWith(const char *encoded, size_t len, uint8_t *out, size_t &outLen, bool vector) {
+  const uint8_t *in = (const uint8_t *)encoded;
+  size_t pads = 0;
+  while (len && in[len - 1] == '=' && pads < 2) {
+    len--;
+    pads++;
+  }
+  size_t tail = len % 4;
+  if (tail == 1 || (pads && (len + pads) % 4)) return false;
+  size_t quads = len / 4;
+  outLen = quads * 3 + (tail ? tail - 1 : 0);
+
+  size_t done = 0;
+#if defined(BASE64_X86) || defined(BASE64_NEON)
+  if (vector) done = decodeVector(in, quads, out, outLen);
+#else
+  (void)vector;
+#endif
+  if (!decodeQuads(in + done * 4, quads - done, out + done * 3)) return false;
+  if (!tail) return true;
+
+  in += quads * 4;
+  out += quads * 3;
+  uint32_t a = decodeTable[in[0]];
+  uint32_t b = decodeTable[in[1]];
+  uint32_t c = tail == 3 ? decodeTable[in[2]] : 0;
+  if ((a | b | c) & 0x80) return false;
+  uint32_t v = (a << 18) | (b << 12) | (c << 6);
+  out[0] = v >> 16;
+  if (tail == 3) out[1] = v >> 8;
+  return true;
+}
+
+size_t Base64::encodedSize(size_t len) {
+  return (len + 2) / 3 * 4;
+}
+
+size_t Base64::decodedSize(const char *encoded, size_t len) {
+  for (int pads = 0; pads < 2 && len && encoded[len - 1] == '='; pads++) len--;
+  return len / 4 * 3 + (len % 4 ? len % 4 - 1 : 0);
+}
+
+size_t Base64::encodePortable(const uint8_t *data, size_t len, char *out) {
+  char *start = out;
+  size_t i = 0;
+  for (; i + 3 <= len; i += 3, out += 4) {
+    uint32_t v = (data[i] << 16) | (data[i + 1] << 8) | data[i + 2];
+    out[0] = alphabet[v >> 18];
+    out[1] = alphabet[(v >> 12) & 0x3f];
+    out[2] = alphabet[(v >> 6) & 0x3f];
+    out[3] = alphabet[v & 0x3f];
+  }
+  if (i < len) {
+    uint32_t v = data[i] << 16;
+    if (i + 1 < len) v |= data[i + 1] << 8;
+    out[0] = alphabet[v >> 18];
+    out[1] = alphabet[(v >> 12) & 0x3f];
+    out[2] = i + 1 < len ? alphabet[(v >> 6) & 0x3f] : '=';
+    out[3] = '=';
+    out += 4;
+  }
+  return out - start;
+}
+
+size_t Base64::encode(const uint8_t *data, size_t len, char *out) {
+#if defined(BASE64_X86) || defined(BASE64_NEON)
+  if (len >= 64) {
+    size_t i = encodeVector(data, len, out);
+    return i / 3 * 4 + encodePortable(data + i, len - i, out + i / 3 * 4);
+  }
+#endif
+  return encodePortable(data, len, out);
+}
+
+bool Base64::decodePortable(const char *encoded, size_t len, uint8_t *out, size_t &outLen) {
+  return decodeWith(encoded, len, out, outLen, false);
+}
+
+bool Base64::decode(const char *encoded, size_t len, uint8_t *out, size_t &outLen) {
+  return decodeWith(encoded, len, out, outLen, len >= 64);
+}
+
+const char *Base64::backend() {
+#if defined(BASE64_X86)
+  return hasAvx2() ? "avx2" : hasSsse3() ? "ssse3" : "portable";
+#elif defined(BASE64_NEON)
+  return "neon";
+#else
+  return "portable";
+#endif
+}
 
 bool Base64::isBase64(uint8_t c) {
-  return (isalnum(c) || (c == '+') || (c == '/'));
+  return decodeTable[c] != 255;
 }
 
 String Base64::encode(const String &data) {
   return encode(reinterpret_cast<const uint8_t*>(data.c_str()), data.length());
 }
 
+// Encoded in slices through a stack buffer, so the String is allocated
+// once at its final size.
 String Base64::encode(const uint8_t* bytes_to_encode, size_t len) {
   String ret;
-  int i = 0;
-  int j = 0;
-  uint8_t char_array_3[3];
-  uint8_t char_array_4[4];
-
-  while (len--) {
-    char_array_3[i++] = *(bytes_to_encode++);
-    if (i == 3) {
-      char_array_4[0] = (char_array_3[0] & 0xfc) >> 2;
-      char_array_4[1] = ((char_array_3[0] & 0x03) << 4) + ((char_array_3[1] & 0xf0) >> 4);
-      char_array_4[2] = ((char_array_3[1] & 0x0f) << 2) + ((char_array_3[2] & 0xc0) >> 6);
-      char_array_4[3] = char_array_3[2] & 0x3f;
-      for (i = 0; (i < 4) ; i++) ret += base64_chars[char_array_4[i]];
-      i = 0;
-    }
-  }
-
-  if (i) {
-    for (j = i; j < 3; j++) char_array_3[j] = '\0';
-    char_array_4[0] = (char_array_3[0] & 0xfc) >> 2;
-    char_array_4[1] = ((char_array_3[0] & 0x03) << 4) + ((char_array_3[1] & 0xf0) >> 4);
-    char_array_4[2] = ((char_array_3[1] & 0x0f) << 2) + ((char_array_3[2] & 0xc0) >> 6);
-    char_array_4[3] = char_array_3[2] & 0x3f;
-    for (j = 0; (j < i + 1); j++)ret += base64_chars[char_array_4[j]];
-    while ((i++ < 3))ret += '=';
+  ret.reserve(encodedSize(len));
+  char chunk[256];
+  for (size_t i = 0; i < len; i += 192) {
+    size_t n = std::min<size_t>(192, len - i);
+    ret.concat(chunk, encode(bytes_to_encode + i, n, chunk));
   }
   return ret;
 }
 
-
+// Decodes up to the first padding or character outside the alphabet.
 String Base64::decode(const String &encoded_string) {
-  int len = encoded_string.length();
-  int i = 0;
-  int j = 0;
-  int in_ = 0;
-  uint8_t char_array_3[3];
-  uint8_t char_array_4[4];
+  const uint8_t *in = (const uint8_t *)encoded_string.c_str();
+  size_t len = 0;
+  while (len < encoded_string.length() && decodeTable[in[len]] != 255) len++;
+  if (len % 4 == 1) len--;
   String ret;
-
-  while (len-- && (encoded_string[in_] != '=') && isBase64(encoded_string[in_])) {
-    char_array_4[i++] = encoded_string[in_];
-    in_++;
-    if (i == 4) {
-      for (i = 0; i < 4; i++) char_array_4[i] = base64_chars.indexOf(char_array_4[i]);
-      char_array_3[0] = (char_array_4[0] << 2) + ((char_array_4[1] & 0x30) >> 4);
-      char_array_3[1] = ((char_array_4[1] & 0xf) << 4) + ((char_array_4[2] & 0x3c) >> 2);
-      char_array_3[2] = ((char_array_4[2] & 0x3) << 6) + char_array_4[3];
-      for (i = 0; (i < 3); i++)ret += (char)char_array_3[i];
-      i = 0;
-    }
-  }
-
-  if (i) {
-    for (j = i; j < 4; j++) char_array_4[j] = 0;
-    for (j = 0; j < 4; j++) char_array_4[j] = base64_chars.indexOf(char_array_4[j]);
-    char_array_3[0] = (char_array_4[0] << 2) + ((char_array_4[1] & 0x30) >> 4);
-    char_array_3[1] = ((char_array_4[1] & 0xf) << 4) + ((char_array_4[2] & 0x3c) >> 2);
-    char_array_3[2] = ((char_array_4[2] & 0x3) << 6) + char_array_4[3];
-    for (j = 0; (j < i - 1); j++) ret += (char)char_array_3[j];
+  ret.reserve(decodedSize((const char *)in, len));
+  uint8_t chunk[192];
+  for (size_t i = 0; i < len; i += 256) {
+    size_t n = std::min<size_t>(256, len - i);
+    size_t outLen = 0;
+    decode((const char *)in + i, n, chunk, outLen);
+    ret.concat((const char *)chunk, outLen);
   }
   return ret;
 }
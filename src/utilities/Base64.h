@@ -3,6 +3,8 @@
 
 #include "Arduino.h"
 
+// Base64 (RFC 4648) with lookup tables. The buffer functions never
+// allocate; on hosts, long inputs go through SSSE3/AVX2 or NEON.
 class Base64 {
   public:
   Base64(){}
@@ -12,8 +14,21 @@ class Base64 {
   String decode(const String &encoded_string);
   bool isBase64(uint8_t c);
 
-  private:
-  static const String base64_chars;
+  // Exact sizes: encodedSize() counts the padding but no terminator, and
+  // decodedSize() is the byte count of a valid, padded or unpadded input.
+  static size_t encodedSize(size_t len);
+  static size_t decodedSize(const char *encoded, size_t len);
+
+  // Writes encodedSize(len) characters to out, without a terminator, and
+  // returns that count.
+  static size_t encode(const uint8_t *data, size_t len, char *out);
+  // Writes decodedSize() bytes to out. False, with nothing useful in out,
+  // if the input has characters outside the alphabet or bad padding.
+  static bool decode(const char *encoded, size_t len, uint8_t *out, size_t &outLen);
+
+  static size_t encodePortable(const uint8_t *data, size_t len, char *out);
+  static bool decodePortable(const char *encoded, size_t len, uint8_t *out, size_t &outLen);
+  static const char *backend();
 };
 
 #endif
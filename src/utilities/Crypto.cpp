@@ -2,13 +2,25 @@
 
 String Crypto::generateHandshakeKey(String key) {
     char base64[SHA1_BASE64_SIZE];
-    SHA1(key)
-        .add("258EAFA5-E914-47DA-95CA-C5AB0DC85B11")
-        .finalize()
-        .getBase64(base64);
+    acceptKey(key.c_str(), key.length(), base64);
     return String(base64);
 }
 
+// Keys are 24 characters, so key and GUID make a 60-byte message. It is
+// laid out on the stack and hashed in one call rather than streamed.
+void Crypto::acceptKey(const char* key, size_t len, char* out) {
+    static const char guid[] = "258EAFA5-E914-47DA-95CA-C5AB0DC85B11";
+    static const size_t guidLen = sizeof(guid) - 1;
+    uint8_t message[64 + guidLen];
+    if (len > sizeof(message) - guidLen) {
+        SHA1().add(key, len).add(guid).finalize().getBase64(out);
+        return;
+    }
+    memcpy(message, key, len);
+    memcpy(message + len, guid, guidLen);
+    SHA1::digest(message, len + guidLen).getBase64(out);
+}
+
 String Crypto::randomBytes(size_t len) {
     static const char data[] = "0123456789abcdefABCDEFGHIJKLMNOPQRSTUVEXYZ";
     srand(millis());
@@ -47,9 +59,12 @@ uint16_t Crypto::swapEndianness(uint16_t num) {
 }
 
 void Crypto::remaskData(String& data, uint8_t maskingKey[4]) {
-    for (int i = 0; i < data.length(); i++) {
-        data.setCharAt(i, data[i] ^ maskingKey[i % 4]);
-    }
+    if (!data.length()) return;
+    Mask::apply((uint8_t*)&data[0], data.length(), maskingKey);
+}
+
+void Crypto::remaskData(uint8_t* data, size_t len, const uint8_t maskingKey[4]) {
+    Mask::apply(data, len, maskingKey);
 }
 
 bool Crypto::shouldAddDefaultHeader(const String& keyWord, const std::vector<std::pair<String, String>>& customHeaders) {
@@ -62,12 +77,17 @@ bool Crypto::shouldAddDefaultHeader(const String& keyWord, const std::vector<std
 }
 
 Crypto::HandshakeRequestResult Crypto::generateHandshake(const String& host, const String& uri, const std::vector<std::pair<String, String>>& customHeaders) {
-    Crypto crypto;
-    Base64 base64;
-    String key = base64.encode(crypto.randomBytes(16));
+    // Not seeded from millis(): clients connecting in the same millisecond
+    // would send the same key.
+    uint8_t nonce[16];
+    for (size_t i = 0; i < sizeof(nonce); i++) nonce[i] = random(256);
+    char key[25];
+    key[Base64::encode(nonce, sizeof(nonce), key)] = 0;
     String handshake = "GET " + uri + " HTTP/1.1\r\n";
     handshake += "Host: " + host + "\r\n";
-    handshake += "Sec-WebSocket-Key: " + key + "\r\n";
+    handshake += "Sec-WebSocket-Key: ";
+    handshake += key;
+    handshake += "\r\n";
 
     for (const auto& header : customHeaders) {
         handshake += header.first + ": " + header.second + "\r\n";
@@ -96,71 +116,8 @@ Crypto::HandshakeRequestResult Crypto::generateHandshake(const String& host, con
     handshake += "\r\n";
     Crypto::HandshakeRequestResult result;
     result.requestStr = handshake;
-    result.expectedAcceptKey = crypto.generateHandshakeKey(key);
-    return result;
-}
-
-Crypto::HandshakeResponseResult Crypto::parseHandshakeResponse(std::vector<String> responseHeaders) {
-    bool didUpgradeToWebsockets = false;
-    bool isConnectionUpgraded = false;
-    String serverAccept = "";
-
-    for (String header : responseHeaders) {
-        int colonIndex = header.indexOf(':');
-        String key = header.substring(0, colonIndex);
-        String value = header.substring(colonIndex + 1);
-        key.trim();
-        value.trim();
-        key.toLowerCase();
-
-        if (key.equals("upgrade")) {
-            value.toLowerCase();
-            didUpgradeToWebsockets = value.equals("websocket");
-        } else if (key.equals("connection")) {
-            value.toLowerCase();
-            isConnectionUpgraded = value.equals("upgrade");
-        } else if (key.equals("sec-websocket-accept")) {
-            serverAccept = value;
-        }
-    }
-
-    Crypto::HandshakeResponseResult result;
-    result.isSuccess = serverAccept != "" && didUpgradeToWebsockets && isConnectionUpgraded;
-    result.serverAccept = serverAccept;
-    return result;
-}
-
-Crypto::HandshakeServerResult Crypto::parseHandshakeRequest(std::vector<String> requestHeaders) {
-    bool isUpgrade = false;
-    bool isConnection = false;
-    bool isSecWebSocketKey = false;
-    bool isSecWebSocketVersion = false;
-    String handshakeKey;
-
-    for (String header : requestHeaders) {
-        int colonIndex = header.indexOf(':');
-        String key = header.substring(0, colonIndex);
-        String value = header.substring(colonIndex + 1);
-        key.trim();
-        value.trim();
-        key.toLowerCase();
-
-        if (key.equals("connection")) {
-            value.toLowerCase();
-            isConnection = value.equals("upgrade");
-        } else if (key.equals("upgrade")) {
-            value.toLowerCase();
-            isUpgrade = value.equals("websocket");
-        } else if (key.equals("sec-websocket-version")) {
-            isSecWebSocketVersion = value.equals("13");
-        } else if (key.equals("sec-websocket-key")) {
-            isSecWebSocketKey = !value.isEmpty();
-            handshakeKey = value;
-        }
-    }
-
-    Crypto::HandshakeServerResult result;
-    result.isValid = isUpgrade && isConnection && isSecWebSocketKey && isSecWebSocketVersion;
-    result.key = generateHandshakeKey(handshakeKey);
+    char accept[SHA1_BASE64_SIZE];
+    acceptKey(key, sizeof(key) - 1, accept);
+    result.expectedAcceptKey = accept;
     return result;
 }
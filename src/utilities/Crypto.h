@@ -3,6 +3,7 @@
 
 #include "Arduino.h"
 #include "Base64.h"
+#include "Mask.h"
 #include "SHA1.h"
 #include "vector"
 
@@ -13,27 +14,19 @@ class Crypto {
         String expectedAcceptKey;
     };
 
-    struct HandshakeResponseResult {
-        bool isSuccess;
-        String serverAccept;
-    };
-
-    struct HandshakeServerResult {
-        bool isValid;
-        String key;
-    };
-
     static String generateHandshakeKey(String key);
+    // Writes the Sec-WebSocket-Accept value for key, with its terminator,
+    // to out, which holds SHA1_BASE64_SIZE bytes.
+    static void acceptKey(const char* key, size_t len, char* out);
     static String randomBytes(size_t len);
     static String getBit(uint64_t data, size_t len);
     static String uint64ToString(uint64_t input);
     static uint16_t swapEndianness(uint16_t num);
     static void remaskData(String& data, uint8_t maskingKey[4]);
+    static void remaskData(uint8_t* data, size_t len, const uint8_t maskingKey[4]);
 
     static bool shouldAddDefaultHeader(const String& keyWord, const std::vector<std::pair<String, String>>& customHeaders);
     static HandshakeRequestResult generateHandshake(const String& host, const String& uri, const std::vector<std::pair<String, String>>& customHeaders);
-    static HandshakeResponseResult parseHandshakeResponse(std::vector<String> responseHeaders);
-    static HandshakeServerResult parseHandshakeRequest(std::vector<String> requestHeaders);
 };
 
 #endif
@@ -0,0 +1,231 @@
+#include "Deflate.h"
+
+#if WS_DEFLATE
+#include <zlib.h>
+#endif
+
+namespace {
+
+struct Offer {
+  bool clientMaxWindowBits = false;
+  uint8_t clientWindowBits = 15;
+  bool serverMaxWindowBits = false;
+  uint8_t serverWindowBits = 15;
+  bool clientNoContextTakeover = false;
+  bool serverNoContextTakeover = false;
+};
+
+bool parseWindowBits(String value, uint8_t &bits) {
+  value.replace("\"", "");
+  value.trim();
+  long v = value.toInt();
+  if (v < 8 || v > 15) return false;
+  bits = v;
+  return true;
+}
+
+// Parses one extension entry, e.g. "permessage-deflate; client_max_window_bits".
+// Unknown parameters make the whole entry unusable, as RFC 7692 requires.
+bool parseOffer(const String &offer, Offer &result) {
+  bool first = true;
+  unsigned int start = 0;
+  while (start <= offer.length()) {
+    int end = offer.indexOf(';', start);
+    if (end < 0) end = offer.length();
+    String name = offer.substring(start, end);
+    String value;
+    start = end + 1;
+    int eq = name.indexOf('=');
+    if (eq >= 0) {
+      value = name.substring(eq + 1);
+      name = name.substring(0, eq);
+    }
+    name.trim();
+    name.toLowerCase();
+
+    if (first) {
+      if (!name.equals("permessage-deflate") || eq >= 0) return false;
+      first = false;
+    } else if (name.equals("client_max_window_bits")) {
+      result.clientMaxWindowBits = true;
+      if (eq >= 0 && !parseWindowBits(value, result.clientWindowBits)) return false;
+    } else if (name.equals("server_max_window_bits")) {
+      result.serverMaxWindowBits = true;
+      if (!parseWindowBits(value, result.serverWindowBits)) return false;
+    } else if (name.equals("client_no_context_takeover") && eq < 0) {
+      result.clientNoContextTakeover = true;
+    } else if (name.equals("server_no_context_takeover") && eq < 0) {
+      result.serverNoContextTakeover = true;
+    } else {
+      return false;
+    }
+  }
+  return !first;
+}
+
+}  // namespace
+
+bool Deflate::isAvailable() {
+  return WS_DEFLATE;
+}
+
+String Deflate::offer(const Options &options) {
+  if (!isAvailable()) return "";
+  String offer = "permessage-deflate; client_max_window_bits";
+  if (options.clientMaxWindowBits < 15) offer += "=" + String(options.clientMaxWindowBits);
+  if (options.serverMaxWindowBits < 15) offer += "; server_max_window_bits=" + String(options.serverMaxWindowBits);
+  if (options.clientNoContextTakeover) offer += "; client_no_context_takeover";
+  if (options.serverNoContextTakeover) offer += "; server_no_context_takeover";
+  return offer;
+}
+
+bool Deflate::accept(const String &offers, const Options &options, String &response, Config &config) {
+  if (!isAvailable()) return false;
+  unsigned int start = 0;
+  while (start < offers.length()) {
+    int end = offers.indexOf(',', start);
+    if (end < 0) end = offers.length();
+    Offer offer;
+    String entry = offers.substring(start, end);
+    start = end + 1;
+    if (!parseOffer(entry, offer)) continue;
+
+    // zlib cannot produce raw deflate streams with a 256-byte window.
+    uint8_t serverBits = std::min(offer.serverWindowBits, options.serverMaxWindowBits);
+    if (serverBits < 9) continue;
+    uint8_t clientBits = offer.clientMaxWindowBits ? std::min(offer.clientWindowBits, options.clientMaxWindowBits) : 15;
+
+    config.deflateWindowBits = serverBits;
+    config.inflateWindowBits = clientBits;
+    config.deflateNoContextTakeover = offer.serverNoContextTakeover || options.serverNoContextTakeover;
+    config.inflateNoContextTakeover = offer.clientNoContextTakeover || options.clientNoContextTakeover;
+    config.memLevel = options.memLevel;
+    config.threshold = options.threshold;
+
+    response = "permessage-deflate";
+    if (config.deflateNoContextTakeover) response += "; server_no_context_takeover";
+    if (config.inflateNoContextTakeover) response += "; client_no_context_takeover";
+    if (offer.serverMaxWindowBits || serverBits < 15) response += "; server_max_window_bits=" + String(serverBits);
+    if (offer.clientMaxWindowBits && clientBits < 15) response += "; client_max_window_bits=" + String(clientBits);
+    return true;
+  }
+  return false;
+}
+
+bool Deflate::configure(const String &response, const Options &options, Config &config) {
+  Offer accepted;
+  if (!isAvailable() || !parseOffer(response, accepted)) return false;
+  if (options.serverNoContextTakeover && !accepted.serverNoContextTakeover) return false;
+  if (options.serverMaxWindowBits < 15 && accepted.serverWindowBits > options.serverMaxWindowBits) return false;
+  if (accepted.clientMaxWindowBits && accepted.clientWindowBits > options.clientMaxWindowBits) return false;
+
+  config.deflateWindowBits = accepted.clientMaxWindowBits ? accepted.clientWindowBits : options.clientMaxWindowBits;
+  config.inflateWindowBits = accepted.serverWindowBits;
+  config.deflateNoContextTakeover = accepted.clientNoContextTakeover || options.clientNoContextTakeover;
+  config.inflateNoContextTakeover = accepted.serverNoContextTakeover;
+  config.memLevel = options.memLevel;
+  config.threshold = options.threshold;
+  return config.deflateWindowBits >= 9;
+}
+
+Deflate::Deflate(const Config &config)
+  : config(config), deflater(NULL), inflater(NULL) {}
+
+Deflate::~Deflate() {
+#if WS_DEFLATE
+  if (deflater) {
+    deflateEnd((z_stream *)deflater);
+    delete (z_stream *)deflater;
+  }
+  if (inflater) {
+    inflateEnd((z_stream *)inflater);
+    delete (z_stream *)inflater;
+  }
+#endif
+}
+
+const Deflate::Config &Deflate::getConfig() const {
+  return config;
+}
+
+bool Deflate::compress(const uint8_t *data, size_t len, std::vector<uint8_t> &out) {
+#if WS_DEFLATE
+  z_stream *stream = (z_stream *)deflater;
+  if (!stream) {
+    stream = new z_stream();
+    if (deflateInit2(stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, -config.deflateWindowBits, config.memLevel, Z_DEFAULT_STRATEGY) != Z_OK) {
+      delete stream;
+      return false;
+    }
+    deflater = stream;
+  }
+
+  out.resize(deflateBound(stream, len) + 16);
+  stream->next_in = (Bytef *)data;
+  stream->avail_in = len;
+  size_t produced = 0;
+  do {
+    if (out.size() - produced < 64) out.resize(out.size() * 2);
+    stream->next_out = out.data() + produced;
+    stream->avail_out = out.size() - produced;
+    int res = deflate(stream, Z_SYNC_FLUSH);
+    if (res != Z_OK && res != Z_BUF_ERROR) return false;
+    produced = out.size() - stream->avail_out;
+  } while (stream->avail_in > 0 || stream->avail_out == 0);
+
+  // Every message ends with an empty stored block; RFC 7692 drops it.
+  static const uint8_t tail[4] = {0x00, 0x00, 0xff, 0xff};
+  if (produced >= 4 && memcmp(out.data() + produced - 4, tail, 4) == 0) produced -= 4;
+  out.resize(produced);
+  if (config.deflateNoContextTakeover) deflateReset(stream);
+  return true;
+#else
+  return false;
+#endif
+}
+
+#if WS_DEFLATE
+static Deflate::Result inflateInto(z_stream *stream, const uint8_t *data, size_t len, std::vector<uint8_t> &out, size_t &outLen, size_t maxLen) {
+  stream->next_in = (Bytef *)data;
+  stream->avail_in = len;
+  while (true) {
+    if (out.size() < outLen + 1024) out.resize(std::max(out.size() * 2, outLen + 4096));
+    stream->next_out = out.data() + outLen;
+    stream->avail_out = out.size() - outLen - 1;
+    int res = inflate(stream, Z_SYNC_FLUSH);
+    if (res == Z_NEED_DICT || res == Z_DATA_ERROR || res == Z_MEM_ERROR || res == Z_STREAM_ERROR) return Deflate::Invalid;
+    outLen = out.size() - 1 - stream->avail_out;
+    if (outLen > maxLen) return Deflate::TooBig;
+    if (res == Z_STREAM_END) {
+      inflateReset(stream);
+      if (!stream->avail_in) break;
+    } else if (res == Z_BUF_ERROR || (!stream->avail_in && stream->avail_out)) {
+      break;
+    }
+  }
+  return Deflate::Ok;
+}
+#endif
+
+Deflate::Result Deflate::decompress(const uint8_t *data, size_t len, bool final, std::vector<uint8_t> &out, size_t &outLen, size_t maxLen) {
+#if WS_DEFLATE
+  z_stream *stream = (z_stream *)inflater;
+  if (!stream) {
+    stream = new z_stream();
+    if (inflateInit2(stream, -std::max<int>(config.inflateWindowBits, 9)) != Z_OK) {
+      delete stream;
+      return Invalid;
+    }
+    inflater = stream;
+  }
+
+  Result res = inflateInto(stream, data, len, out, outLen, maxLen);
+  if (res != Ok || !final) return res;
+  static const uint8_t tail[4] = {0x00, 0x00, 0xff, 0xff};
+  res = inflateInto(stream, tail, sizeof(tail), out, outLen, maxLen);
+  if (config.inflateNoContextTakeover) inflateReset(stream);
+  return res;
+#else
+  return Invalid;
+#endif
+}
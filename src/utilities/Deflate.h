@@ -0,0 +1,64 @@
+#ifndef DEFLATE_H
+#define DEFLATE_H
+
+#include "Arduino.h"
+#include "vector"
+
+// permessage-deflate (RFC 7692). Compression needs zlib, so it is only
+// compiled in when WS_DEFLATE is 1 (the host build sets it when zlib is
+// found). Without it negotiation always declines and peers fall back to
+// uncompressed messages.
+#ifndef WS_DEFLATE
+#define WS_DEFLATE 0
+#endif
+
+class Deflate {
+  public:
+    struct Options {
+      uint8_t clientMaxWindowBits = 15;
+      uint8_t serverMaxWindowBits = 15;
+      bool clientNoContextTakeover = false;
+      bool serverNoContextTakeover = false;
+      uint8_t memLevel = 8;
+      size_t threshold = 64;
+    };
+
+    // Negotiated parameters from the point of view of one endpoint.
+    struct Config {
+      uint8_t deflateWindowBits = 15;
+      uint8_t inflateWindowBits = 15;
+      bool deflateNoContextTakeover = false;
+      bool inflateNoContextTakeover = false;
+      uint8_t memLevel = 8;
+      size_t threshold = 64;
+    };
+
+    enum Result {
+      Ok,
+      TooBig,
+      Invalid
+    };
+
+    static const uint8_t Rsv1 = 0x4;
+
+    static bool isAvailable();
+    static String offer(const Options &options);
+    static bool accept(const String &offers, const Options &options, String &response, Config &config);
+    static bool configure(const String &response, const Options &options, Config &config);
+
+    Deflate(const Config &config);
+    ~Deflate();
+    Deflate(const Deflate &) = delete;
+    Deflate &operator=(const Deflate &) = delete;
+
+    const Config &getConfig() const;
+    bool compress(const uint8_t *data, size_t len, std::vector<uint8_t> &out);
+    Result decompress(const uint8_t *data, size_t len, bool final, std::vector<uint8_t> &out, size_t &outLen, size_t maxLen);
+
+  private:
+    Config config;
+    void *deflater;
+    void *inflater;
+};
+
+#endif
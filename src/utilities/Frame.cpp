@@ -1,13 +1,17 @@
 #include "Frame.h"
 
 bool Frame::isValid(Frame::Opcode opcode){
-  return opcode == 0 || opcode == Frame::Text || opcode == Frame::Binary || opcode == Frame::Close || opcode == Frame::Ping || opcode == Frame::Pong;
+  return opcode == Frame::Continuation || opcode == Frame::Text || opcode == Frame::Binary || opcode == Frame::Close || opcode == Frame::Ping || opcode == Frame::Pong;
+}
+
+bool Frame::isControl(uint8_t opcode) {
+  return opcode & 0x8;
 }
 
 Frame::Header::Header(uint16_t data, uint64_t extendedPayload) {
   data    = Crypto::swapEndianness(data);
   fin     = (data >> 15) & 0x1;
-  flags   = (data >> 12) & 0x8;
+  flags   = (data >> 12) & 0x7;
   opcode  = (data >> 8) & 0xF;
   mask    = (data >> 7) & 0x1;
   payload = (data & 0x7F);
@@ -55,6 +59,20 @@ uint64_t Frame::Header::getExtendedPayload() {
   }
 }
 
+size_t Frame::Header::size() const {
+  return payload < 126 ? 2 : payload == 126 ? 4 : 10;
+}
+
+size_t Frame::Header::encode(uint8_t* data) const {
+  data[0] = (fin << 7) | (flags << 4) | opcode;
+  data[1] = (mask << 7) | payload;
+  size_t len = size();
+  for (size_t i = 2; i < len; i++) {
+    data[i] = extendedPayload >> ((len - i - 1) * 8);
+  }
+  return len;
+}
+
 String Frame::Header::getBinarySequence(String delimiter) {
   String str = Crypto::getBit(fin, 1)
                + delimiter + Crypto::getBit(flags, 3)
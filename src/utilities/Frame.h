@@ -7,6 +7,7 @@
 class Frame {
   public:
     enum Opcode {
+      Continuation = 0x0,
       Text = 0x1,
       Binary = 0x2,
       Close = 0x8,
@@ -27,10 +28,15 @@ class Frame {
 
       uint16_t getBinary();
       uint64_t getExtendedPayload();
+      size_t size() const;
+      size_t encode(uint8_t* data) const;
       String getBinarySequence(String delimiter = "");
     };
 
+    static const size_t MaxHeaderSize = 14;
+
     static bool isValid(Opcode opcode);
+    static bool isControl(uint8_t opcode);
 };
 
 #endif
@@ -0,0 +1,78 @@
+#include "FrameParser.h"
+
+FrameParser::FrameParser() {
+  reset();
+}
+
+void FrameParser::reset() {
+  state = ReadHeader;
+  header = Frame::Header();
+  length = 0;
+  received = 0;
+  memset(maskingKey, 0, sizeof(maskingKey));
+}
+
+bool FrameParser::readHeader(RingBuffer &buffer) {
+  uint8_t data[8];
+  while (state != ReadPayload) {
+    switch (state) {
+      case ReadHeader:
+        if (buffer.size() < 2) return false;
+        buffer.read(data, 2);
+        header = Frame::Header((uint16_t)(data[0] | (data[1] << 8)));
+        length = header.payload;
+        state = header.payload >= 126 ? ReadExtendedLength : header.mask ? ReadMask : ReadPayload;
+        break;
+      case ReadExtendedLength: {
+        size_t len = header.payload == 126 ? 2 : 8;
+        if (buffer.size() < len) return false;
+        buffer.read(data, len);
+        length = 0;
+        for (size_t i = 0; i < len; i++) length = (length << 8) | data[i];
+        header.extendedPayload = length;
+        state = header.mask ? ReadMask : ReadPayload;
+        break;
+      }
+      case ReadMask:
+        if (buffer.size() < 4) return false;
+        buffer.read(maskingKey, 4);
+        state = ReadPayload;
+        break;
+      case ReadPayload:
+        break;
+    }
+  }
+  return true;
+}
+
+size_t FrameParser::readPayload(RingBuffer &buffer, uint8_t *data, size_t len) {
+  if (len > remaining()) len = remaining();
+  size_t done = 0;
+  while (done < len && !buffer.empty()) {
+    size_t n = 0;
+    const uint8_t *src = buffer.readPtr(n);
+    n = std::min(n, len - done);
+    if (header.mask) {
+      Mask::copy(data + done, src, n, maskingKey, received);
+    } else {
+      memcpy(data + done, src, n);
+    }
+    buffer.skip(n);
+    received += n;
+    done += n;
+  }
+  return done;
+}
+
+void FrameParser::consume(uint8_t *data, size_t len) {
+  if (header.mask) Mask::apply(data, len, maskingKey, received);
+  received += len;
+}
+
+uint64_t FrameParser::remaining() const {
+  return length - received;
+}
+
+bool FrameParser::isComplete() const {
+  return state == ReadPayload && received >= length;
+}
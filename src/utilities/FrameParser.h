@@ -0,0 +1,36 @@
+#ifndef FRAME_PARSER_H
+#define FRAME_PARSER_H
+
+#include "Arduino.h"
+#include "Frame.h"
+#include "Mask.h"
+#include "RingBuffer.h"
+
+// Resumable frame reader. Each call consumes whatever part of the current
+// frame is already buffered and remembers where it stopped, so a peer that
+// trickles bytes never makes the caller wait.
+class FrameParser {
+  public:
+    enum State {
+      ReadHeader,
+      ReadExtendedLength,
+      ReadMask,
+      ReadPayload
+    };
+
+    State state;
+    Frame::Header header;
+    uint64_t length;
+    uint64_t received;
+    uint8_t maskingKey[4];
+
+    FrameParser();
+    void reset();
+    bool readHeader(RingBuffer &buffer);
+    size_t readPayload(RingBuffer &buffer, uint8_t *data, size_t len);
+    void consume(uint8_t *data, size_t len);
+    uint64_t remaining() const;
+    bool isComplete() const;
+};
+
+#endif
@@ -0,0 +1,235 @@
+#include "HandshakeParser.h"
+
+#include "Crypto.h"
+
+namespace {
+
+inline char lower(char c) {
+  return c >= 'A' && c <= 'Z' ? c + ('a' - 'A') : c;
+}
+
+inline bool isSpace(char c) {
+  return c == ' ' || c == '\t' || c == '\r';
+}
+
+// Whether a comma-separated header value lists token, ignoring case.
+// token must be lower case.
+bool hasToken(const char *list, size_t len, const char *token) {
+  size_t tokenLen = strlen(token);
+  size_t i = 0;
+  while (i < len) {
+    while (i < len && (isSpace(list[i]) || list[i] == ',')) i++;
+    size_t start = i;
+    while (i < len && list[i] != ',') i++;
+    size_t end = i;
+    while (end > start && isSpace(list[end - 1])) end--;
+    if (end - start != tokenLen) continue;
+    size_t j = 0;
+    while (j < tokenLen && lower(list[start + j]) == token[j]) j++;
+    if (j == tokenLen) return true;
+  }
+  return false;
+}
+
+}  // namespace
+
+HandshakeParser::HandshakeParser(Kind kind) {
+  reset(kind);
+}
+
+void HandshakeParser::reset(Kind kind) {
+  this->kind = kind;
+  state = StartLine;
+  field = Other;
+  size = 0;
+  linePos = 0;
+  code = 0;
+  headers = 0;
+  upgrade = false;
+  connection = false;
+  version = false;
+  nameLen = 0;
+  valueLen = 0;
+  keyLen = 0;
+  keyValue[0] = 0;
+  extensionLen = 0;
+  extensionList[0] = 0;
+}
+
+HandshakeParser::Status HandshakeParser::feed(const uint8_t *data, size_t len, size_t &consumed) {
+  consumed = 0;
+  while (consumed < len && state != Done && state != Failed) {
+    if (++size > WS_MAX_HANDSHAKE_SIZE) {
+      state = Failed;
+      break;
+    }
+    step((char)data[consumed++]);
+  }
+  return status();
+}
+
+HandshakeParser::Status HandshakeParser::status() const {
+  return state == Done ? Complete : state == Failed ? Invalid : Incomplete;
+}
+
+bool HandshakeParser::isUpgrade() const {
+  if (state != Done || !upgrade || !connection || !keyLen) return false;
+  return kind == Request ? version : code == 101;
+}
+
+uint16_t HandshakeParser::statusCode() const {
+  return code;
+}
+
+uint16_t HandshakeParser::headerCount() const {
+  return headers;
+}
+
+const char *HandshakeParser::key() const {
+  return keyValue;
+}
+
+const char *HandshakeParser::extensions() const {
+  return extensionList;
+}
+
+void HandshakeParser::acceptKey(char *out) const {
+  Crypto::acceptKey(keyValue, keyLen, out);
+}
+
+void HandshakeParser::step(char c) {
+  switch (state) {
+    case StartLine:
+      startLine(c);
+      break;
+    case Name:
+      if (c == '\n') {
+        // A blank line ends the headers; any other line needs a colon.
+        state = nameLen ? Failed : Done;
+      } else if (c == ':') {
+        if (++headers > WS_MAX_HANDSHAKE_HEADERS) {
+          state = Failed;
+          break;
+        }
+        beginValue();
+        state = Value;
+      } else if (!isSpace(c)) {
+        if (nameLen < sizeof(name)) name[nameLen] = lower(c);
+        nameLen++;
+      }
+      break;
+    case Value:
+      if (c == '\n') {
+        endValue();
+        if (state == Failed) break;
+        nameLen = 0;
+        state = Name;
+      } else if (field != Other && (valueLen || !isSpace(c))) {
+        addValue(c);
+      }
+      break;
+    default:
+      break;
+  }
+}
+
+// "GET <path> ..." for a request, "HTTP/1.1 <code> ..." for a response.
+void HandshakeParser::startLine(char c) {
+  const char *prefix = kind == Request ? "GET " : "HTTP/1.1 ";
+  size_t prefixLen = kind == Request ? 4 : 9;
+  size_t needed = prefixLen + (kind == Request ? 1 : 3);
+  if (c == '\n') {
+    state = linePos < needed ? Failed : Name;
+    return;
+  }
+  if (linePos < prefixLen) {
+    if (c != prefix[linePos]) state = Failed;
+  } else if (kind == Response && linePos < needed) {
+    if (c < '0' || c > '9') state = Failed;
+    code = code * 10 + (c - '0');
+  }
+  linePos++;
+}
+
+void HandshakeParser::beginValue() {
+  static const struct {
+    const char *name;
+    Field field;
+  } fields[] = {
+    {"upgrade", Upgrade},
+    {"connection", Connection},
+    {"sec-websocket-version", Version},
+    {"sec-websocket-key", Key},
+    {"sec-websocket-accept", Accept},
+    {"sec-websocket-extensions", Extensions},
+  };
+  field = Other;
+  valueLen = 0;
+  if (nameLen > sizeof(name)) return;
+  for (size_t i = 0; i < sizeof(fields) / sizeof(fields[0]); i++) {
+    if (strlen(fields[i].name) == nameLen && !memcmp(fields[i].name, name, nameLen)) {
+      field = fields[i].field;
+      break;
+    }
+  }
+  // The key arrives in requests, the accept value in responses.
+  if ((field == Key && kind != Request) || (field == Accept && kind != Response)) field = Other;
+}
+
+void HandshakeParser::addValue(char c) {
+  if (field == Extensions) {
+    // Values of repeated headers are joined into one list.
+    bool separate = !valueLen && extensionLen;
+    if (extensionLen + (separate ? 2 : 0) + 1 >= sizeof(extensionList)) {
+      state = Failed;
+      return;
+    }
+    if (separate) {
+      extensionList[extensionLen++] = ',';
+      extensionList[extensionLen++] = ' ';
+    }
+    extensionList[extensionLen++] = c;
+    valueLen++;
+    return;
+  }
+  if (valueLen >= sizeof(value)) {
+    state = Failed;
+    return;
+  }
+  value[valueLen++] = c;
+}
+
+void HandshakeParser::endValue() {
+  if (field == Extensions) {
+    while (valueLen && isSpace(extensionList[extensionLen - 1])) {
+      extensionLen--;
+      valueLen--;
+    }
+    extensionList[extensionLen] = 0;
+    return;
+  }
+  while (valueLen && isSpace(value[valueLen - 1])) valueLen--;
+  switch (field) {
+    case Upgrade:
+      upgrade = hasToken(value, valueLen, "websocket");
+      break;
+    case Connection:
+      connection = hasToken(value, valueLen, "upgrade");
+      break;
+    case Version:
+      version = valueLen == 2 && value[0] == '1' && value[1] == '3';
+      break;
+    case Key:
+    case Accept:
+      if (valueLen >= sizeof(keyValue)) {
+        state = Failed;
+        return;
+      }
+      memcpy(keyValue, value, valueLen);
+      keyValue[valueLen] = 0;
+      keyLen = valueLen;
+      break;
+    default:
+      break;
+  }
+}
@@ -0,0 +1,109 @@
+#ifndef HANDSHAKE_PARSER_H
+#define HANDSHAKE_PARSER_H
+
+#include "Arduino.h"
+
+// Limits on an upgrade request or response: its total size up to the blank
+// line, the number of header lines, and the room kept for the joined
+// Sec-WebSocket-Extensions values. Anything bigger is rejected.
+#ifndef WS_MAX_HANDSHAKE_SIZE
+#define WS_MAX_HANDSHAKE_SIZE 4096
+#endif
+
+#ifndef WS_MAX_HANDSHAKE_HEADERS
+#define WS_MAX_HANDSHAKE_HEADERS 32
+#endif
+
+#ifndef WS_MAX_EXTENSIONS_SIZE
+#if defined(ESP32) || defined(ESP8266)
+#define WS_MAX_EXTENSIONS_SIZE 128
+#else
+#define WS_MAX_EXTENSIONS_SIZE 256
+#endif
+#endif
+
+// Streaming parser for the HTTP side of the opening handshake. Bytes are
+// consumed as they arrive, header names are matched case-insensitively as
+// they are read, and only the values the handshake needs are kept, in
+// fixed buffers, so parsing never allocates.
+class HandshakeParser {
+  public:
+    enum Kind {
+      Request,
+      Response
+    };
+
+    enum Status {
+      Incomplete,
+      Complete,
+      Invalid
+    };
+
+    HandshakeParser(Kind kind = Request);
+    void reset(Kind kind);
+
+    // Consumes bytes up to and including the blank line that ends the
+    // headers. consumed is how many were used; anything after them is
+    // already WebSocket data.
+    Status feed(const uint8_t *data, size_t len, size_t &consumed);
+    Status status() const;
+
+    // Whether every header an upgrade needs is present and valid, and for
+    // a response, whether the status is 101.
+    bool isUpgrade() const;
+    uint16_t statusCode() const;
+    uint16_t headerCount() const;
+
+    // Sec-WebSocket-Key of a request, or Sec-WebSocket-Accept of a response.
+    const char *key() const;
+    // Every Sec-WebSocket-Extensions value, joined with ", ".
+    const char *extensions() const;
+    // The Sec-WebSocket-Accept value that answers this request's key.
+    void acceptKey(char *out) const;
+
+  private:
+    enum State {
+      StartLine,
+      Name,
+      Value,
+      Done,
+      Failed
+    };
+
+    enum Field {
+      Other,
+      Upgrade,
+      Connection,
+      Version,
+      Key,
+      Accept,
+      Extensions
+    };
+
+    Kind kind;
+    State state;
+    Field field;
+    size_t size;
+    size_t linePos;
+    uint16_t code;
+    uint16_t headers;
+    bool upgrade;
+    bool connection;
+    bool version;
+    char name[24];
+    size_t nameLen;
+    char value[64];
+    size_t valueLen;
+    char keyValue[33];
+    size_t keyLen;
+    char extensionList[WS_MAX_EXTENSIONS_SIZE];
+    size_t extensionLen;
+
+    void step(char c);
+    void startLine(char c);
+    void beginValue();
+    void addValue(char c);
+    void endValue();
+};
+
+#endif
@@ -0,0 +1,197 @@
+#include "Mask.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__)) && defined(__SSE2__)
+#define MASK_SSE2
+#include <immintrin.h>
+#elif defined(__ARM_NEON) || defined(__aarch64__)
+#define MASK_NEON
+#include <arm_neon.h>
+#endif
+
+// Fills pattern with the key rotated so that pattern[0] lines up with
+// payload byte `offset`.
+static void rotateKey(uint8_t *pattern, size_t len, const uint8_t key[4], size_t offset) {
+  for (size_t i = 0; i < len; i++) pattern[i] = key[(offset + i) & 3];
+}
+
+// Masks bytes until data is aligned to `align`, returning how many were done.
+static size_t maskHead(uint8_t *data, size_t len, const uint8_t key[4], size_t offset, size_t align) {
+  size_t i = 0;
+  while (i < len && ((uintptr_t)(data + i) & (align - 1))) {
+    data[i] ^= key[(offset + i) & 3];
+    i++;
+  }
+  return i;
+}
+
+static size_t maskWords(uint8_t *data, size_t len, const uint8_t *pattern) {
+  uint64_t k;
+  memcpy(&k, pattern, 8);
+  size_t i = 0;
+  for (; i + 8 <= len; i += 8) {
+    uint64_t w;
+    memcpy(&w, data + i, 8);
+    w ^= k;
+    memcpy(data + i, &w, 8);
+  }
+  return i;
+}
+
+static void maskTail(uint8_t *data, size_t len, const uint8_t key[4], size_t offset) {
+  for (size_t i = 0; i < len; i++) data[i] ^= key[(offset + i) & 3];
+}
+
+static size_t copyWords(uint8_t *dst, const uint8_t *src, size_t len, const uint8_t *pattern) {
+  uint64_t k;
+  memcpy(&k, pattern, 8);
+  size_t i = 0;
+  for (; i + 8 <= len; i += 8) {
+    uint64_t w;
+    memcpy(&w, src + i, 8);
+    w ^= k;
+    memcpy(dst + i, &w, 8);
+  }
+  return i;
+}
+
+void Mask::copyPortable(uint8_t *dst, const uint8_t *src, size_t len, const uint8_t key[4], size_t offset) {
+  size_t i = 0;
+  if (len >= 8) {
+    uint8_t pattern[8];
+    rotateKey(pattern, sizeof(pattern), key, offset);
+    i = copyWords(dst, src, len, pattern);
+  }
+  for (; i < len; i++) dst[i] = src[i] ^ key[(offset + i) & 3];
+}
+
+void Mask::applyPortable(uint8_t *data, size_t len, const uint8_t key[4], size_t offset) {
+  size_t i = maskHead(data, len, key, offset, 8);
+  if (len - i >= 8) {
+    uint8_t pattern[8];
+    rotateKey(pattern, sizeof(pattern), key, offset + i);
+    i += maskWords(data + i, len - i, pattern);
+  }
+  maskTail(data + i, len - i, key, offset + i);
+}
+
+#ifdef MASK_SSE2
+__attribute__((target("avx2"))) static size_t maskAvx2(uint8_t *data, size_t len, const uint8_t *pattern) {
+  __m256i k = _mm256_loadu_si256((const __m256i *)pattern);
+  size_t i = 0;
+  for (; i + 64 <= len; i += 64) {
+    __m256i a = _mm256_load_si256((const __m256i *)(data + i));
+    __m256i b = _mm256_load_si256((const __m256i *)(data + i + 32));
+    _mm256_store_si256((__m256i *)(data + i), _mm256_xor_si256(a, k));
+    _mm256_store_si256((__m256i *)(data + i + 32), _mm256_xor_si256(b, k));
+  }
+  for (; i + 32 <= len; i += 32) {
+    __m256i a = _mm256_load_si256((const __m256i *)(data + i));
+    _mm256_store_si256((__m256i *)(data + i), _mm256_xor_si256(a, k));
+  }
+  return i;
+}
+
+__attribute__((target("avx2"))) static size_t copyAvx2(uint8_t *dst, const uint8_t *src, size_t len, const uint8_t *pattern) {
+  __m256i k = _mm256_loadu_si256((const __m256i *)pattern);
+  size_t i = 0;
+  for (; i + 32 <= len; i += 32) {
+    __m256i a = _mm256_loadu_si256((const __m256i *)(src + i));
+    _mm256_storeu_si256((__m256i *)(dst + i), _mm256_xor_si256(a, k));
+  }
+  return i;
+}
+
+static size_t copySse2(uint8_t *dst, const uint8_t *src, size_t len, const uint8_t *pattern) {
+  __m128i k = _mm_loadu_si128((const __m128i *)pattern);
+  size_t i = 0;
+  for (; i + 16 <= len; i += 16) {
+    __m128i a = _mm_loadu_si128((const __m128i *)(src + i));
+    _mm_storeu_si128((__m128i *)(dst + i), _mm_xor_si128(a, k));
+  }
+  return i;
+}
+
+static size_t maskSse2(uint8_t *data, size_t len, const uint8_t *pattern) {
+  __m128i k = _mm_loadu_si128((const __m128i *)pattern);
+  size_t i = 0;
+  for (; i + 16 <= len; i += 16) {
+    __m128i a = _mm_load_si128((const __m128i *)(data + i));
+    _mm_store_si128((__m128i *)(data + i), _mm_xor_si128(a, k));
+  }
+  return i;
+}
+
+static bool hasAvx2() {
+  static const bool supported = __builtin_cpu_supports("avx2");
+  return supported;
+}
+#endif
+
+#ifdef MASK_NEON
+static size_t maskNeon(uint8_t *data, size_t len, const uint8_t *pattern) {
+  uint8x16_t k = vld1q_u8(pattern);
+  size_t i = 0;
+  for (; i + 16 <= len; i += 16) vst1q_u8(data + i, veorq_u8(vld1q_u8(data + i), k));
+  return i;
+}
+
+static size_t copyNeon(uint8_t *dst, const uint8_t *src, size_t len, const uint8_t *pattern) {
+  uint8x16_t k = vld1q_u8(pattern);
+  size_t i = 0;
+  for (; i + 16 <= len; i += 16) vst1q_u8(dst + i, veorq_u8(vld1q_u8(src + i), k));
+  return i;
+}
+#endif
+
+void Mask::copy(uint8_t *dst, const uint8_t *src, size_t len, const uint8_t key[4], size_t offset) {
+#if defined(MASK_SSE2) || defined(MASK_NEON)
+  if (len >= 256) {
+    uint8_t pattern[32];
+    rotateKey(pattern, sizeof(pattern), key, offset);
+    size_t i = 0;
+#ifdef MASK_SSE2
+    if (hasAvx2()) i = copyAvx2(dst, src, len, pattern);
+    i += copySse2(dst + i, src + i, len - i, pattern);
+#else
+    i = copyNeon(dst, src, len, pattern);
+#endif
+    copyPortable(dst + i, src + i, len - i, key, offset + i);
+    return;
+  }
+#endif
+  copyPortable(dst, src, len, key, offset);
+}
+
+void Mask::apply(uint8_t *data, size_t len, const uint8_t key[4], size_t offset) {
+#if defined(MASK_SSE2) || defined(MASK_NEON)
+  if (len >= 256) {
+#ifdef MASK_SSE2
+    size_t align = hasAvx2() ? 32 : 16;
+#else
+    size_t align = 16;
+#endif
+    size_t i = maskHead(data, len, key, offset, align);
+    uint8_t pattern[32];
+    rotateKey(pattern, sizeof(pattern), key, offset + i);
+#ifdef MASK_SSE2
+    if (align == 32) i += maskAvx2(data + i, len - i, pattern);
+    i += maskSse2(data + i, len - i, pattern);
+#else
+    i += maskNeon(data + i, len - i, pattern);
+#endif
+    applyPortable(data + i, len - i, key, offset + i);
+    return;
+  }
+#endif
+  applyPortable(data, len, key, offset);
+}
+
+const char *Mask::backend() {
+#if defined(MASK_SSE2)
+  return hasAvx2() ? "avx2" : "sse2";
+#elif defined(MASK_NEON)
+  return "neon";
+#else
+  return "portable";
+#endif
+}
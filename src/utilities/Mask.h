@@ -0,0 +1,17 @@
+#ifndef MASK_H
+#define MASK_H
+
+#include "Arduino.h"
+
+// WebSocket payload masking (RFC 6455 section 5.3). The key is rotated by
+// offset, so a payload can be masked in several pieces.
+class Mask {
+  public:
+    static void apply(uint8_t *data, size_t len, const uint8_t key[4], size_t offset = 0);
+    static void applyPortable(uint8_t *data, size_t len, const uint8_t key[4], size_t offset = 0);
+    static void copy(uint8_t *dst, const uint8_t *src, size_t len, const uint8_t key[4], size_t offset = 0);
+    static void copyPortable(uint8_t *dst, const uint8_t *src, size_t len, const uint8_t key[4], size_t offset = 0);
+    static const char *backend();
+};
+
+#endif
@@ -0,0 +1,70 @@
+#include "RingBuffer.h"
+
+RingBuffer::RingBuffer(size_t capacity)
+  : mask(0), head(0), tail(0) {
+  reset(capacity);
+}
+
+void RingBuffer::reset(size_t capacity) {
+  size_t size = 1;
+  while (size < capacity) size <<= 1;
+  data.assign(capacity ? size : 0, 0);
+  mask = capacity ? size - 1 : 0;
+  head = tail = 0;
+}
+
+void RingBuffer::clear() {
+  head = tail = 0;
+}
+
+size_t RingBuffer::size() const {
+  return head - tail;
+}
+
+size_t RingBuffer::space() const {
+  return data.size() - size();
+}
+
+size_t RingBuffer::capacity() const {
+  return data.size();
+}
+
+bool RingBuffer::empty() const {
+  return head == tail;
+}
+
+uint8_t *RingBuffer::writePtr(size_t &len) {
+  size_t offset = head & mask;
+  len = std::min(space(), data.size() - offset);
+  return data.data() + offset;
+}
+
+void RingBuffer::commit(size_t len) {
+  head += std::min(len, space());
+}
+
+const uint8_t *RingBuffer::readPtr(size_t &len) const {
+  size_t offset = tail & mask;
+  len = std::min(size(), data.size() - offset);
+  return data.data() + offset;
+}
+
+size_t RingBuffer::peek(uint8_t *dst, size_t len, size_t offset) const {
+  if (offset >= size()) return 0;
+  len = std::min(len, size() - offset);
+  size_t start = (tail + offset) & mask;
+  size_t first = std::min(len, data.size() - start);
+  memcpy(dst, data.data() + start, first);
+  memcpy(dst + first, data.data(), len - first);
+  return len;
+}
+
+size_t RingBuffer::read(uint8_t *dst, size_t len) {
+  len = peek(dst, len);
+  tail += len;
+  return len;
+}
+
+void RingBuffer::skip(size_t len) {
+  tail += std::min(len, size());
+}
@@ -0,0 +1,35 @@
+#ifndef RING_BUFFER_H
+#define RING_BUFFER_H
+
+#include "Arduino.h"
+#include "vector"
+
+// Byte FIFO with a power-of-two capacity. Producers fill it through
+// writePtr()/commit() so a socket can read straight into free space, and
+// consumers can look at contiguous data through readPtr() without copying.
+class RingBuffer {
+  public:
+    RingBuffer(size_t capacity = 0);
+
+    void reset(size_t capacity);
+    void clear();
+    size_t size() const;
+    size_t space() const;
+    size_t capacity() const;
+    bool empty() const;
+
+    uint8_t *writePtr(size_t &len);
+    void commit(size_t len);
+    const uint8_t *readPtr(size_t &len) const;
+    size_t peek(uint8_t *data, size_t len, size_t offset = 0) const;
+    size_t read(uint8_t *data, size_t len);
+    void skip(size_t len);
+
+  private:
+    std::vector<uint8_t> data;
+    size_t mask;
+    size_t head;
+    size_t tail;
+};
+
+#endif
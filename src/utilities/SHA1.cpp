@@ -1,5 +1,130 @@
 #include "SHA1.h"
 
+#include "Base64.h"
+
+#if defined(ESP32)
+#define SHA1_ESP32
+#include "mbedtls/sha1.h"
+#include "mbedtls/version.h"
+#elif defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define SHA1_SHANI
+#include <cpuid.h>
+#include <immintrin.h>
+#elif defined(__GNUC__) && defined(__aarch64__) && defined(__linux__)
+#define SHA1_ARMV8
+#include <arm_neon.h>
+#include <sys/auxv.h>
+#ifndef HWCAP_SHA1
+#define HWCAP_SHA1 (1 << 5)
+#endif
+#ifdef __clang__
+#define SHA1_ARMV8_TARGET __attribute__((target("crypto")))
+#else
+#define SHA1_ARMV8_TARGET __attribute__((target("+crypto")))
+#endif
+#endif
+
+#if defined(SHA1_SHANI) || defined(SHA1_ARMV8)
+typedef void (*BlockFunction)(uint32_t state[5], const uint8_t *data, size_t count);
+#endif
+
+#ifdef SHA1_SHANI
+// Intel's SHA extensions, four rounds per sha1rnds4.
+__attribute__((target("sha,sse4.1,ssse3"))) static void blocksShaNi(uint32_t state[5], const uint8_t *data, size_t count) {
+  const __m128i byteSwap = _mm_set_epi64x(0x0001020304050607ULL, 0x08090a0b0c0d0e0fULL);
+  __m128i abcd = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *)state), 0x1b);
+  __m128i e0 = _mm_set_epi32(state[4], 0, 0, 0);
+  for (; count; count--, data += 64) {
+    __m128i abcdSaved = abcd;
+    __m128i eSaved = e0;
+    __m128i w[4];
+    for (int k = 0; k < 4; k++) w[k] = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(data + k * 16)), byteSwap);
+
+    __m128i e = _mm_add_epi32(e0, w[0]);
+    __m128i previous = abcd;
+#pragma GCC unroll 20
+    for (int k = 0; k < 20; k++) {
+      if (k) {
+        e = _mm_sha1nexte_epu32(previous, w[k & 3]);
+        previous = abcd;
+      }
+      switch (k / 5) {
+        case 0:
+          abcd = _mm_sha1rnds4_epu32(abcd, e, 0);
+          break;
+        case 1:
+          abcd = _mm_sha1rnds4_epu32(abcd, e, 1);
+          break;
+        case 2:
+          abcd = _mm_sha1rnds4_epu32(abcd, e, 2);
+          break;
+        default:
+          abcd = _mm_sha1rnds4_epu32(abcd, e, 3);
+          break;
+      }
+      if (k < 16) w[k & 3] = _mm_sha1msg2_epu32(_mm_xor_si128(_mm_sha1msg1_epu32(w[k & 3], w[(k + 1) & 3]), w[(k + 2) & 3]), w[(k + 3) & 3]);
+    }
+    e0 = _mm_sha1nexte_epu32(previous, eSaved);
+    abcd = _mm_add_epi32(abcd, abcdSaved);
+  }
+  _mm_storeu_si128((__m128i *)state, _mm_shuffle_epi32(abcd, 0x1b));
+  state[4] = _mm_extract_epi32(e0, 3);
+}
+
+static BlockFunction acceleratedBlocks() {
+  unsigned int eax, ebx, ecx, edx;
+  if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx) || !(ecx & bit_SSSE3) || !(ecx & bit_SSE4_1)) return NULL;
+  if (!__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx) || !(ebx & (1 << 29))) return NULL;
+  return blocksShaNi;
+}
+#endif
+
+#ifdef SHA1_ARMV8
+// ARMv8 crypto extensions, four rounds per sha1c/sha1p/sha1m.
+SHA1_ARMV8_TARGET static void blocksArmv8(uint32_t state[5], const uint8_t *data, size_t count) {
+  static const uint32_t constants[4] = {0x5a827999, 0x6ed9eba1, 0x8f1bbcdc, 0xca62c1d6};
+  uint32x4_t abcd = vld1q_u32(state);
+  uint32_t e0 = state[4];
+  for (; count; count--, data += 64) {
+    uint32x4_t abcdSaved = abcd;
+    uint32_t eSaved = e0;
+    uint32x4_t w[4];
+    for (int k = 0; k < 4; k++) w[k] = vreinterpretq_u32_u8(vrev32q_u8(vld1q_u8(data + k * 16)));
+
+    uint32_t e = e0;
+#pragma GCC unroll 20
+    for (int k = 0; k < 20; k++) {
+      if (k >= 4) w[k & 3] = vsha1su1q_u32(vsha1su0q_u32(w[k & 3], w[(k + 1) & 3], w[(k + 2) & 3]), w[(k + 3) & 3]);
+      uint32x4_t wk = vaddq_u32(w[k & 3], vdupq_n_u32(constants[k / 5]));
+      uint32_t next = vsha1h_u32(vgetq_lane_u32(abcd, 0));
+      if (k < 5) {
+        abcd = vsha1cq_u32(abcd, e, wk);
+      } else if (k < 10 || k >= 15) {
+        abcd = vsha1pq_u32(abcd, e, wk);
+      } else {
+        abcd = vsha1mq_u32(abcd, e, wk);
+      }
+      e = next;
+    }
+    e0 = e + eSaved;
+    abcd = vaddq_u32(abcd, abcdSaved);
+  }
+  vst1q_u32(state, abcd);
+  state[4] = e0;
+}
+
+static BlockFunction acceleratedBlocks() {
+  return (getauxval(AT_HWCAP) & HWCAP_SHA1) ? blocksArmv8 : NULL;
+}
+#endif
+
+#if defined(SHA1_SHANI) || defined(SHA1_ARMV8)
+static BlockFunction hardwareBlocks() {
+  static const BlockFunction blocks = acceleratedBlocks();
+  return blocks;
+}
+#endif
+
 SHA1::SHA1(const char* text)
   : i(0), n_bits(0) {
   state[0] = 0x67452301;
@@ -33,13 +158,22 @@ SHA1 &SHA1::add(char c) {
 SHA1 &SHA1::add(const void *data, uint32_t n) {
   if (!data) return *this;
   const uint8_t *ptr = (const uint8_t*)data;
-  for (; n && i % sizeof(buf); n--) add(*ptr++);
-  for (; n >= sizeof(buf); n -= sizeof(buf)) {
-    process_block(ptr);
-    ptr += sizeof(buf);
-    n_bits += sizeof(buf) * 8;
+  n_bits += (uint64_t)n * 8;
+  if (i) {
+    uint32_t len = std::min<uint32_t>(n, sizeof(buf) - i);
+    memcpy(buf + i, ptr, len);
+    i += len;
+    ptr += len;
+    n -= len;
+    if (i < sizeof(buf)) return *this;
+    i = 0;
+    process_blocks(buf, 1);
   }
-  for (; n; n--) add(*ptr++);
+  process_blocks(ptr, n / sizeof(buf));
+  ptr += n - n % sizeof(buf);
+  n %= sizeof(buf);
+  memcpy(buf, ptr, n);
+  i = n;
   return *this;
 }
 
@@ -67,26 +201,9 @@ const SHA1 &SHA1::getHex(char *hex, bool zero_terminate, const char *alphabet) c
 }
 
 const SHA1 &SHA1::getBase64(char *base64, bool zero_terminate) const {
-  static const uint8_t *table = (const uint8_t*) "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
-  uint32_t triples[7] = {
-    ((state[0] & 0xffffff00) >> 1 * 8),
-    ((state[0] & 0x000000ff) << 2 * 8) | ((state[1] & 0xffff0000) >> 2 * 8),
-    ((state[1] & 0x0000ffff) << 1 * 8) | ((state[2] & 0xff000000) >> 3 * 8),
-    ((state[2] & 0x00ffffff) << 0 * 8),
-    ((state[3] & 0xffffff00) >> 1 * 8),
-    ((state[3] & 0x000000ff) << 2 * 8) | ((state[4] & 0xffff0000) >> 2 * 8),
-    ((state[4] & 0x0000ffff) << 1 * 8),
-  };
-
-  for (int i = 0; i < 7; i++) {
-    uint32_t x = triples[i];
-    base64[i * 4 + 0] = table[(x >> 3 * 6) % 64];
-    base64[i * 4 + 1] = table[(x >> 2 * 6) % 64];
-    base64[i * 4 + 2] = table[(x >> 1 * 6) % 64];
-    base64[i * 4 + 3] = table[(x >> 0 * 6) % 64];
-  }
-
-  base64[SHA1_BASE64_SIZE - 2] = '=';
+  uint8_t digest[20];
+  for (int k = 0; k < 20; k++) digest[k] = state[k / 4] >> (24 - k % 4 * 8);
+  Base64::encode(digest, sizeof(digest), base64);
   if (zero_terminate) base64[SHA1_BASE64_SIZE - 1] = '\0';
   return *this;
 }
@@ -103,12 +220,75 @@ String SHA1::getBase64String() {
   return String(base64);
 }
 
+SHA1 SHA1::digest(const void *data, size_t len) {
+#ifdef SHA1_ESP32
+  uint8_t out[20];
+#if MBEDTLS_VERSION_MAJOR >= 3
+  mbedtls_sha1((const unsigned char *)data, len, out);
+#else
+  mbedtls_sha1_ret((const unsigned char *)data, len, out);
+#endif
+  SHA1 sha;
+  for (int k = 0; k < 5; k++) sha.state[k] = sha.make_word(out + k * 4);
+  return sha;
+#else
+  return hash(data, len, true);
+#endif
+}
+
+SHA1 SHA1::digestPortable(const void *data, size_t len) {
+  return hash(data, len, false);
+}
+
+// Whole blocks are hashed straight from data; the tail and padding are
+// laid out in one go instead of a byte at a time.
+SHA1 SHA1::hash(const void *data, size_t len, bool accelerated) {
+  SHA1 sha;
+  const uint8_t *ptr = (const uint8_t *)data;
+  size_t full = len / 64;
+  sha.process_blocks(ptr, full, accelerated);
+
+  uint8_t tail[128];
+  size_t rest = len % 64;
+  size_t blocks = rest < 56 ? 1 : 2;
+  memcpy(tail, ptr + full * 64, rest);
+  tail[rest] = 0x80;
+  memset(tail + rest + 1, 0, blocks * 64 - rest - 9);
+  uint64_t bits = (uint64_t)len * 8;
+  for (int j = 0; j < 8; j++) tail[blocks * 64 - 1 - j] = bits >> j * 8;
+  sha.process_blocks(tail, blocks, accelerated);
+  return sha;
+}
+
+const char *SHA1::backend() {
+#if defined(SHA1_ESP32)
+  return "esp32";
+#elif defined(SHA1_SHANI)
+  return hardwareBlocks() ? "sha-ni" : "portable";
+#elif defined(SHA1_ARMV8)
+  return hardwareBlocks() ? "armv8" : "portable";
+#else
+  return "portable";
+#endif
+}
+
 void SHA1::add_byte_dont_count_bits(uint8_t x) {
   buf[i++] = x;
   if (i >= sizeof(buf)) {
     i = 0;
-    process_block(buf);
+    process_blocks(buf, 1);
+  }
+}
+
+void SHA1::process_blocks(const uint8_t *ptr, size_t count, bool accelerated) {
+#if defined(SHA1_SHANI) || defined(SHA1_ARMV8)
+  BlockFunction blocks = accelerated ? hardwareBlocks() : NULL;
+  if (blocks) {
+    if (count) blocks(state, ptr, count);
+    return;
   }
+#endif
+  for (; count; count--, ptr += 64) process_block(ptr);
 }
 
 uint32_t SHA1::rol32(uint32_t x, uint32_t n) {
@@ -6,6 +6,10 @@
 #define SHA1_HEX_SIZE (40 + 1)
 #define SHA1_BASE64_SIZE (28 + 1)
 
+// SHA-1 with pluggable block backends. On hosts, blocks go through SHA-NI
+// (x86) or the ARMv8 SHA-1 instructions when the CPU has them, checked at
+// runtime. On ESP32, digest() hashes on the SHA peripheral through the
+// core's mbedtls port. Everything else uses the portable code.
 class SHA1 {
   public:
     SHA1(const char* text = NULL);
@@ -20,13 +24,21 @@ class SHA1 {
     String getHexString();
     String getBase64String();
 
+    // Hashes a whole message in one call. The result is read with getHex()
+    // or getBase64() as usual.
+    static SHA1 digest(const void *data, size_t len);
+    static SHA1 digestPortable(const void *data, size_t len);
+    static const char *backend();
+
   private:
     uint32_t state[5];
     uint8_t buf[64];
     uint32_t i;
     uint64_t n_bits;
     void add_byte_dont_count_bits(uint8_t x);
+    void process_blocks(const uint8_t *ptr, size_t count, bool accelerated = true);
     void process_block(const uint8_t *ptr);
+    static SHA1 hash(const void *data, size_t len, bool accelerated);
     uint32_t rol32(uint32_t x, uint32_t n);
     uint32_t make_word(const uint8_t *p);
     void shaRound(uint8_t r, uint32_t* w, uint32_t &v, uint32_t &u, uint32_t &x, uint32_t &y, uint32_t &z, uint32_t i);
@@ -0,0 +1,148 @@
+#ifndef SLOT_MAP_H
+#define SLOT_MAP_H
+
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "Arduino.h"
+
+// Pool of objects addressed by slot number. Objects are constructed in
+// place in fixed-size pages and never move, so references stay valid until
+// the object is erased. Each slot has a generation that changes when it is
+// freed, which lets callers tell a stale (slot, generation) pair from the
+// object now living there. A dense list of occupied slots makes iteration
+// proportional to the number of objects, and erase() is O(1): the last
+// entry is swapped into the hole, so iteration order is not preserved.
+template <typename T, size_t PageSize = 16>
+class SlotMap {
+  public:
+    class iterator {
+      public:
+        iterator(SlotMap *map, size_t index) : map(map), index(index) {}
+        T &operator*() const { return map->at(map->dense[index]); }
+        T *operator->() const { return &map->at(map->dense[index]); }
+        iterator &operator++() {
+          index++;
+          return *this;
+        }
+        bool operator==(const iterator &other) const { return index == other.index; }
+        bool operator!=(const iterator &other) const { return index != other.index; }
+
+      private:
+        SlotMap *map;
+        size_t index;
+    };
+
+    SlotMap() {}
+
+    ~SlotMap() {
+      clear();
+    }
+
+    SlotMap(const SlotMap &) = delete;
+    SlotMap &operator=(const SlotMap &) = delete;
+
+    // Constructs a T in a free slot, reusing freed slots before adding
+    // pages, and returns the slot number.
+    template <typename... Args>
+    uint32_t emplace(Args &&...args) {
+      uint32_t slot;
+      if (!freeSlots.empty()) {
+        slot = freeSlots.back();
+        freeSlots.pop_back();
+      } else {
+        slot = slots.size();
+        if (slot % PageSize == 0) pages.emplace_back(new Storage[PageSize]);
+        slots.push_back(Slot());
+      }
+      new (pointer(slot)) T(std::forward<Args>(args)...);
+      slots[slot].index = dense.size();
+      dense.push_back(slot);
+      return slot;
+    }
+
+    // Destroys the object in slot and bumps the slot's generation.
+    void erase(uint32_t slot) {
+      if (!contains(slot)) return;
+      Slot &entry = slots[slot];
+      pointer(slot)->~T();
+      uint32_t last = dense.back();
+      dense[entry.index] = last;
+      slots[last].index = entry.index;
+      dense.pop_back();
+      entry.index = -1;
+      if (!++entry.generation) entry.generation = 1;
+      freeSlots.push_back(slot);
+    }
+
+    void clear() {
+      while (!dense.empty()) erase(dense.back());
+    }
+
+    bool contains(uint32_t slot) const {
+      return slot < slots.size() && slots[slot].index >= 0;
+    }
+
+    // Never 0, so a packed key containing it is never 0 either.
+    uint32_t generation(uint32_t slot) const {
+      return slot < slots.size() ? slots[slot].generation : 1;
+    }
+
+    // The object in slot if it is still the one generation referred to.
+    T *get(uint32_t slot, uint32_t generation) {
+      if (!contains(slot) || slots[slot].generation != generation) return NULL;
+      return pointer(slot);
+    }
+
+    T &at(uint32_t slot) {
+      return *pointer(slot);
+    }
+
+    // The slot emplace() will use next.
+    uint32_t nextSlot() const {
+      return freeSlots.empty() ? slots.size() : freeSlots.back();
+    }
+
+    // Objects in dense order, for code that indexes instead of iterating.
+    T &operator[](size_t index) {
+      return at(dense[index]);
+    }
+
+    size_t size() const {
+      return dense.size();
+    }
+
+    bool empty() const {
+      return dense.empty();
+    }
+
+    iterator begin() {
+      return iterator(this, 0);
+    }
+
+    iterator end() {
+      return iterator(this, dense.size());
+    }
+
+  private:
+    typedef typename std::aligned_storage<sizeof(T), alignof(T)>::type Storage;
+
+    struct Slot {
+      uint32_t generation = 1;
+      int32_t index = -1;  // position in dense, -1 while free
+    };
+
+    std::vector<std::unique_ptr<Storage[]>> pages;
+    std::vector<Slot> slots;
+    std::vector<uint32_t> freeSlots;
+    std::vector<uint32_t> dense;
+
+    T *pointer(uint32_t slot) {
+      return reinterpret_cast<T *>(&pages[slot / PageSize][slot % PageSize]);
+    }
+};
+
+#endif
@@ -0,0 +1,166 @@
+#ifndef TEST_UTIL_H
+#define TEST_UTIL_H
+
+#include <errno.h>
+#include <sys/socket.h>
+
+#include <string>
+
+#include "../bench/BenchUtil.h"
+#include "WSServer.h"
+
+namespace test {
+
+static const char request[] =
+    "GET / HTTP/1.1\r\n"
+    "Host: 127.0.0.1\r\n"
+    "Upgrade: websocket\r\n"
+    "Connection: Upgrade\r\n"
+    "Sec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\n"
+    "Sec-WebSocket-Version: 13\r\n"
+    "\r\n";
+
+// A blocking loopback connection. A receive buffer of 0 keeps the default.
+inline int openConnection(uint16_t port, int receiveBuffer = 0) {
+    int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) return -1;
+    if (receiveBuffer) ::setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &receiveBuffer, sizeof(receiveBuffer));
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons(port);
+    if (::connect(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
+        ::close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// A client speaking raw bytes to the server under test. The read calls run
+// the server while they wait, and give up after timeout seconds.
+class Peer {
+   public:
+    explicit Peer(uint16_t port, int receiveBuffer = 0) : fd(openConnection(port, receiveBuffer)), eof(false) {}
+    ~Peer() {
+        if (fd >= 0) ::close(fd);
+    }
+
+    bool isOpen() const {
+        return fd >= 0;
+    }
+
+    bool send(const std::string& data) {
+        return ::send(fd, data.data(), data.size(), MSG_NOSIGNAL) == (ssize_t)data.size();
+    }
+
+    // Sends a masked frame. flags holds the RSV bits, RSV1 being 4.
+    bool sendFrame(uint8_t opcode, const std::string& payload, bool fin = true, uint8_t flags = 0) {
+        static const uint8_t key[4] = {0x12, 0x34, 0x56, 0x78};
+        std::string frame;
+        frame += char((fin ? 0x80 : 0) | flags << 4 | opcode);
+        if (payload.size() < 126) {
+            frame += char(0x80 | payload.size());
+        } else if (payload.size() < 65536) {
+            frame += char(0x80 | 126);
+            for (int shift = 8; shift >= 0; shift -= 8) frame += char(payload.size() >> shift);
+        } else {
+            frame += char(0x80 | 127);
+            for (int shift = 56; shift >= 0; shift -= 8) frame += char((uint64_t)payload.size() >> shift);
+        }
+        frame.append((const char*)key, 4);
+        for (size_t i = 0; i < payload.size(); i++) frame += char(payload[i] ^ key[i % 4]);
+        return send(frame);
+    }
+
+    // Sends the upgrade request; true once the 101 arrives.
+    bool upgrade(WSServer& server) {
+        return send(request) && readResponse(server).find("HTTP/1.1 101") == 0;
+    }
+
+    // The response head, or "" if the connection ended first.
+    std::string readResponse(WSServer& server, double timeout = 1.5) {
+        bench::Clock::time_point start = bench::Clock::now();
+        size_t end;
+        while ((end = in.find("\r\n\r\n")) == std::string::npos) {
+            if (!pump(server) || bench::secondsSince(start) > timeout) return "";
+        }
+        std::string head = in.substr(0, end + 4);
+        in.erase(0, end + 4);
+        return head;
+    }
+
+    // The next whole frame the server sends.
+    bool readFrame(WSServer& server, uint8_t& opcode, std::string& payload, double timeout = 1.5) {
+        bench::Clock::time_point start = bench::Clock::now();
+        while (true) {
+            if (in.size() >= 2) {
+                uint64_t len = in[1] & 0x7f;
+                size_t head = len == 126 ? 4 : len == 127 ? 10 : 2;
+                if (in.size() >= head) {
+                    if (head > 2) len = 0;
+                    for (size_t i = 2; i < head; i++) len = len << 8 | (uint8_t)in[i];
+                    if (in.size() >= head + len) {
+                        opcode = in[0] & 0x0f;
+                        payload = in.substr(head, len);
+                        in.erase(0, head + len);
+                        return true;
+                    }
+                }
+            }
+            if (!pump(server) || bench::secondsSince(start) > timeout) return false;
+        }
+    }
+
+    // The code of the close frame the server sends, skipping any frames
+    // before it; 0 if none arrives.
+    int closeCode(WSServer& server, double timeout = 1.5) {
+        uint8_t opcode;
+        std::string payload;
+        while (readFrame(server, opcode, payload, timeout)) {
+            if (opcode != Frame::Close) continue;
+            return payload.size() >= 2 ? (uint8_t)payload[0] << 8 | (uint8_t)payload[1] : 1005;
+        }
+        return 0;
+    }
+
+    // Whether the server ends the connection, discarding what it sends.
+    bool closed(WSServer& server, double timeout = 1.5) {
+        bench::Clock::time_point start = bench::Clock::now();
+        while (pump(server)) {
+            in.clear();
+            if (bench::secondsSince(start) > timeout) return false;
+        }
+        return true;
+    }
+
+    // Reads whatever is buffered on the socket without running the server.
+    size_t drain() {
+        char buffer[65536];
+        size_t total = 0;
+        ssize_t len;
+        while ((len = ::recv(fd, buffer, sizeof(buffer), MSG_DONTWAIT)) > 0) total += len;
+        return total;
+    }
+
+   private:
+    // One server pass, then whatever arrived. False once the server has
+    // closed the connection and everything it sent has been read.
+    bool pump(WSServer& server) {
+        if (eof) return false;
+        server.run(5);
+        char buffer[4096];
+        ssize_t len;
+        while ((len = ::recv(fd, buffer, sizeof(buffer), MSG_DONTWAIT)) > 0) in.append(buffer, len);
+        if (len == 0 || (len < 0 && errno != EAGAIN && errno != EWOULDBLOCK)) eof = true;
+        return !eof || !in.empty();
+    }
+
+    int fd;
+    std::string in;
+    bool eof;
+};
+
+}  // namespace test
+
+#endif
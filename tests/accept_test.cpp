@@ -0,0 +1,91 @@
+// Regression tests for WSServer's accept loop on the epoll reactor.
+//
+// stranded: a connection that closes before it is accepted must not stop
+// the loop, or the valid ones queued behind it are never accepted (the
+// listen socket is edge-triggered and does not report them again).
+//
+// saturated: silent peers holding every pending handshake slot must not
+// make run() spin, and the connection waiting behind them must be
+// accepted once their handshakes time out.
+//
+// idle rate: the accept rate reported after a burst falls back to 0 once
+// no more connections arrive.
+
+#include "TestUtil.h"
+
+using test::openConnection;
+using test::request;
+
+static bool stranded(uint16_t port) {
+    WSServer server(port, 16);
+    int upgraded = 0;
+    server.onConnection([&](WSClient&) { upgraded++; });
+    server.begin();
+
+    ::close(openConnection(port));
+    std::vector<int> fds;
+    for (int i = 0; i < 3; i++) {
+        int fd = openConnection(port);
+        if (fd >= 0 && ::send(fd, request, strlen(request), MSG_NOSIGNAL) > 0) fds.push_back(fd);
+    }
+
+    bench::Clock::time_point start = bench::Clock::now();
+    while (upgraded < 3 && bench::secondsSince(start) < 1.5) server.run(10);
+    for (int fd : fds) ::close(fd);
+    printf("stranded: upgraded %d of 3, backlog %d\n", upgraded, server.getAcceptStats().backlog);
+    return fds.size() == 3 && upgraded == 3;
+}
+
+static bool saturated(uint16_t port) {
+    WSServer server(port, 16);
+    int upgraded = 0;
+    server.onConnection([&](WSClient&) { upgraded++; });
+    server.setMaxPendingHandshakes(2);
+    server.setHandshakeTimeout(300);
+    server.begin();
+
+    std::vector<int> fds;
+    for (int i = 0; i < 3; i++) fds.push_back(openConnection(port));
+    ::send(fds[2], request, strlen(request), MSG_NOSIGNAL);
+
+    long passes = 0;
+    bench::Clock::time_point start = bench::Clock::now();
+    while (bench::secondsSince(start) < 1) {
+        server.run(100);
+        passes++;
+    }
+    for (int fd : fds) ::close(fd);
+    printf("saturated: %ld passes in 1 s, upgraded %d of 1\n", passes, upgraded);
+    return passes < 100 && upgraded == 1;
+}
+
+static bool idleRate(uint16_t port) {
+    WSServer server(port, 16);
+    int upgraded = 0;
+    server.onConnection([&](WSClient&) { upgraded++; });
+    server.begin();
+
+    std::vector<int> fds;
+    for (int i = 0; i < 10; i++) {
+        int fd = openConnection(port);
+        if (fd >= 0 && ::send(fd, request, strlen(request), MSG_NOSIGNAL) > 0) fds.push_back(fd);
+    }
+    bench::Clock::time_point start = bench::Clock::now();
+    uint32_t peak = 0;
+    while (bench::secondsSince(start) < 3.5) {
+        server.run(10);
+        peak = std::max(peak, server.getAcceptStats().acceptRate);
+    }
+    uint32_t rate = server.getAcceptStats().acceptRate;
+    for (int fd : fds) ::close(fd);
+    printf("idle rate: upgraded %d, peak %u/s, after 3.5 s %u/s\n", upgraded, peak, rate);
+    return upgraded == 10 && peak > 0 && rate == 0;
+}
+
+int main(int argc, char** argv) {
+    uint16_t port = bench::option(argc, argv, "port", 8795);
+    bool ok = stranded(port);
+    ok = saturated(port + 1) && ok;
+    ok = idleRate(port + 2) && ok;
+    return ok ? 0 : 1;
+}
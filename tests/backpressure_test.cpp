@@ -0,0 +1,106 @@
+// Tests for the outbound queue, against a raw socket that stops reading.
+//
+// drop message: past maxQueued, sends are refused but the connection
+// stays, and takes messages again once the peer has caught up.
+//
+// drop connection: past maxQueued, the connection is dropped with 1008.
+//
+// drain: past the high watermark the connection is not writable, and
+// onDrain fires once the peer has read the queue down to the low one.
+
+#include "TestUtil.h"
+
+static const size_t limit = 64 * 1024;
+
+// Sends 16 KB messages until one is refused or the connection goes.
+static bool fill(WSServer& server, WSClient::Handle handle, WSClient* ws = NULL) {
+    String message;
+    message.reserve(16 * 1024);
+    for (int i = 0; i < 16 * 1024; i++) message += 'x';
+    for (int i = 0; i < 4000; i++) {
+        if (!server.send(handle, message) || !server.hasClient(handle)) return true;
+        if (ws && !ws->isWritable()) return true;
+        server.run(0);
+    }
+    return false;
+}
+
+// Reads everything the server has for the peer, until wanted() holds.
+template <typename Predicate>
+static bool catchUp(WSServer& server, test::Peer& peer, Predicate wanted) {
+    bench::Clock::time_point start = bench::Clock::now();
+    while (!wanted() && bench::secondsSince(start) < 3) {
+        server.run(1);
+        peer.drain();
+    }
+    return wanted();
+}
+
+static bool dropMessage(uint16_t port) {
+    WSServer server(port, 16);
+    server.setMaxQueuedBytes(limit, WSClient::DropMessage);
+    WSClient* ws = NULL;
+    server.onConnection([&](WSClient& client) { ws = &client; });
+    server.begin();
+
+    test::Peer peer(port, 4096);
+    bool upgraded = peer.upgrade(server) && ws;
+    if (!upgraded) return false;
+    WSClient::Handle handle = ws->handle;
+    bool refused = fill(server, handle);
+    size_t queued = ws->getQueuedBytes();
+    bool kept = server.hasClient(handle);
+    bool drained = catchUp(server, peer, [&]() { return ws->getQueuedBytes() == 0; });
+    bool resumed = server.send(handle, "after");
+    printf("drop message: refused %d at %zu queued, kept %d, drained %d, resumed %d\n", refused, queued, kept, drained, resumed);
+    return refused && queued <= limit + 16 * 1024 + 4 && kept && drained && resumed;
+}
+
+static bool dropConnection(uint16_t port) {
+    WSServer server(port, 16);
+    server.setMaxQueuedBytes(limit, WSClient::DropConnection);
+    WSClient::Handle handle = 0;
+    String reason;
+    server.onConnection([&](WSClient& client) {
+        handle = client.handle;
+        client.onClose([&](WSClient&, String why) { reason = why; });
+    });
+    server.begin();
+
+    test::Peer peer(port, 4096);
+    bool upgraded = peer.upgrade(server) && handle;
+    if (!upgraded) return false;
+    bool dropped = fill(server, handle);
+    for (int i = 0; i < 10; i++) server.run(1);
+    bool closed = peer.closed(server, 3);
+    printf("drop connection: dropped %d, reason \"%s\", closed %d\n", dropped, reason.c_str(), closed);
+    return dropped && reason.startsWith("1008") && !server.hasClient(handle) && closed;
+}
+
+static bool drain(uint16_t port) {
+    WSServer server(port, 16);
+    server.setWatermarks(32 * 1024, 8 * 1024);
+    WSClient* ws = NULL;
+    int drains = 0;
+    server.onConnection([&](WSClient& client) {
+        ws = &client;
+        client.onDrain([&](WSClient&) { drains++; });
+    });
+    server.begin();
+
+    test::Peer peer(port, 4096);
+    bool upgraded = peer.upgrade(server) && ws;
+    if (!upgraded) return false;
+    bool blocked = fill(server, ws->handle, ws) && !ws->isWritable();
+    bool writable = catchUp(server, peer, [&]() { return drains > 0; }) && ws->isWritable();
+    printf("drain: blocked %d, drains %d, writable again %d\n", blocked, drains, writable);
+    return blocked && drains == 1 && writable;
+}
+
+int main(int argc, char** argv) {
+    uint16_t port = bench::option(argc, argv, "port", 8830);
+    bool ok = dropMessage(port);
+    ok = dropConnection(port + 1) && ok;
+    ok = drain(port + 2) && ok;
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,117 @@
+// Tests for permessage-deflate on the server, over raw sockets. Messages
+// are compressed here with zlib directly.
+//
+// round trip: the extension is negotiated and a compressed message arrives
+// as the original text.
+//
+// rsv1 on continuation: only the first frame of a message may set RSV1, so
+// a continuation with it closes the connection with 1002.
+//
+// rsv1 not negotiated: RSV1 without the extension closes with 1002.
+//
+// inflate bomb: a frame within maxMessageSize that inflates past it closes
+// the connection with 1009.
+
+#include <zlib.h>
+
+#include "TestUtil.h"
+
+static const char* offer = "Sec-WebSocket-Extensions: permessage-deflate\r\n";
+
+// A raw deflate stream flushed to a byte boundary, without the trailing
+// 00 00 ff ff, as RFC 7692 sends it.
+static std::string compress(const std::string& data) {
+    z_stream stream;
+    memset(&stream, 0, sizeof(stream));
+    deflateInit2(&stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY);
+    std::string out(deflateBound(&stream, data.size()) + 16, '\0');
+    stream.next_in = (Bytef*)data.data();
+    stream.avail_in = data.size();
+    stream.next_out = (Bytef*)&out[0];
+    stream.avail_out = out.size();
+    deflate(&stream, Z_SYNC_FLUSH);
+    out.resize(out.size() - stream.avail_out - 4);
+    deflateEnd(&stream);
+    return out;
+}
+
+static bool upgrade(WSServer& server, test::Peer& peer, bool& negotiated) {
+    std::string request = test::request;
+    request.insert(request.size() - 2, offer);
+    std::string response = peer.send(request) ? peer.readResponse(server) : "";
+    negotiated = response.find("Sec-WebSocket-Extensions: permessage-deflate") != std::string::npos;
+    return response.find("HTTP/1.1 101") == 0;
+}
+
+static bool roundTrip(uint16_t port) {
+    WSServer server(port, 16);
+    server.setCompression(Deflate::Options());
+    std::vector<String> messages;
+    server.onConnection([&](WSClient& ws) { ws.onMessage([&](WSClient&, String data) { messages.push_back(data); }); });
+    server.begin();
+
+    test::Peer peer(port);
+    bool negotiated;
+    bool upgraded = upgrade(server, peer, negotiated);
+    std::string text = "{\"sensor\":\"temperature\",\"value\":21.5,\"sensor\":\"temperature\"}";
+    peer.sendFrame(Frame::Text, compress(text), true, Deflate::Rsv1);
+    bench::Clock::time_point start = bench::Clock::now();
+    while (messages.empty() && bench::secondsSince(start) < 1) server.run(5);
+    bool received = messages.size() == 1 && messages[0] == text.c_str();
+    printf("round trip: negotiated %d, received %d\n", negotiated, received);
+    return upgraded && negotiated && received;
+}
+
+static bool rsv1OnContinuation(uint16_t port) {
+    WSServer server(port, 16);
+    server.setCompression(Deflate::Options());
+    server.begin();
+
+    test::Peer peer(port);
+    bool negotiated;
+    bool upgraded = upgrade(server, peer, negotiated);
+    std::string payload = compress("a message in two frames");
+    size_t half = payload.size() / 2;
+    peer.sendFrame(Frame::Text, payload.substr(0, half), false, Deflate::Rsv1);
+    peer.sendFrame(Frame::Continuation, payload.substr(half), true, Deflate::Rsv1);
+    int code = peer.closeCode(server);
+    printf("rsv1 on continuation: close %d\n", code);
+    return upgraded && negotiated && code == 1002;
+}
+
+static bool rsv1NotNegotiated(uint16_t port) {
+    WSServer server(port, 16);
+    server.begin();
+
+    test::Peer peer(port);
+    bool upgraded = peer.upgrade(server);
+    peer.sendFrame(Frame::Text, compress("hello"), true, Deflate::Rsv1);
+    int code = peer.closeCode(server);
+    printf("rsv1 not negotiated: close %d\n", code);
+    return upgraded && code == 1002;
+}
+
+static bool inflateBomb(uint16_t port) {
+    WSServer server(port, 16);
+    server.setCompression(Deflate::Options());
+    server.onConnection([](WSClient& ws) { ws.setMaxMessageSize(4096); });
+    server.begin();
+
+    test::Peer peer(port);
+    bool negotiated;
+    bool upgraded = upgrade(server, peer, negotiated);
+    std::string bomb = compress(std::string(1 << 20, 'x'));
+    peer.sendFrame(Frame::Text, bomb, true, Deflate::Rsv1);
+    int code = peer.closeCode(server);
+    printf("inflate bomb: %zu bytes inflating to 1 MB, close %d\n", bomb.size(), code);
+    return upgraded && negotiated && bomb.size() < 4096 && code == 1009;
+}
+
+int main(int argc, char** argv) {
+    uint16_t port = bench::option(argc, argv, "port", 8820);
+    bool ok = roundTrip(port);
+    ok = rsv1OnContinuation(port + 1) && ok;
+    ok = rsv1NotNegotiated(port + 2) && ok;
+    ok = inflateBomb(port + 3) && ok;
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,74 @@
+// Tests for fragmented messages, over raw sockets.
+//
+// interleaved: a ping between two fragments is answered with a pong, and
+// the fragments around it still make up one message.
+//
+// orphan continuation: a continuation frame with no message started closes
+// the connection with 1002.
+//
+// nested message: a new text frame before the open message has finished
+// closes the connection with 1002.
+//
+// too big: fragments adding up to more than maxMessageSize close the
+// connection with 1009 when nothing streams the message.
+
+#include "TestUtil.h"
+
+static bool interleaved(uint16_t port) {
+    WSServer server(port, 16);
+    std::vector<String> messages;
+    server.onConnection([&](WSClient& ws) { ws.onMessage([&](WSClient&, String data) { messages.push_back(data); }); });
+    server.begin();
+
+    test::Peer peer(port);
+    bool upgraded = peer.upgrade(server);
+    peer.sendFrame(Frame::Text, "Hel", false);
+    peer.sendFrame(Frame::Ping, "p");
+    peer.sendFrame(Frame::Continuation, "lo");
+    uint8_t opcode = 0;
+    std::string payload;
+    bool ponged = peer.readFrame(server, opcode, payload) && opcode == Frame::Pong && payload == "p";
+    bench::Clock::time_point start = bench::Clock::now();
+    while (messages.empty() && bench::secondsSince(start) < 1) server.run(5);
+    bool reassembled = messages.size() == 1 && messages[0] == "Hello";
+    printf("interleaved: pong %d, reassembled %d\n", ponged, reassembled);
+    return upgraded && ponged && reassembled;
+}
+
+static int closeCodeAfter(uint16_t port, size_t maxMessageSize, const std::vector<std::pair<uint8_t, bool>>& frames) {
+    WSServer server(port, 16);
+    server.onConnection([&](WSClient& ws) { ws.setMaxMessageSize(maxMessageSize); });
+    server.begin();
+
+    test::Peer peer(port);
+    if (!peer.upgrade(server)) return -1;
+    for (const auto& frame : frames) peer.sendFrame(frame.first, "0123456789", frame.second);
+    return peer.closeCode(server);
+}
+
+static bool orphanContinuation(uint16_t port) {
+    int code = closeCodeAfter(port, 1024, {{Frame::Continuation, true}});
+    printf("orphan continuation: close %d\n", code);
+    return code == 1002;
+}
+
+static bool nestedMessage(uint16_t port) {
+    int code = closeCodeAfter(port, 1024, {{Frame::Text, false}, {Frame::Text, true}});
+    printf("nested message: close %d\n", code);
+    return code == 1002;
+}
+
+static bool tooBig(uint16_t port) {
+    int code = closeCodeAfter(port, 16, {{Frame::Text, false}, {Frame::Continuation, true}});
+    printf("too big: close %d\n", code);
+    return code == 1009;
+}
+
+int main(int argc, char** argv) {
+    uint16_t port = bench::option(argc, argv, "port", 8810);
+    bool ok = interleaved(port);
+    ok = orphanContinuation(port + 1) && ok;
+    ok = nestedMessage(port + 2) && ok;
+    ok = tooBig(port + 3) && ok;
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,90 @@
+// Tests for the server side of the opening handshake, over raw sockets.
+//
+// split: a request that arrives a few bytes at a time is upgraded, with the
+// accept key from RFC 6455's example.
+//
+// oversized: a request larger than WS_MAX_HANDSHAKE_SIZE is dropped without
+// a response.
+//
+// too many headers: more than WS_MAX_HANDSHAKE_HEADERS headers are dropped
+// the same way.
+//
+// not an upgrade: a complete request without the upgrade headers gets a
+// 400 instead of a 101.
+
+#include "TestUtil.h"
+
+static bool split(uint16_t port) {
+    WSServer server(port, 16);
+    int upgraded = 0;
+    server.onConnection([&](WSClient&) { upgraded++; });
+    server.begin();
+
+    test::Peer peer(port);
+    std::string request = test::request;
+    for (size_t i = 0; i < request.size(); i += 7) {
+        peer.send(request.substr(i, 7));
+        server.run(5);
+    }
+    std::string response = peer.readResponse(server);
+    bool ok = response.find("HTTP/1.1 101") == 0 && response.find("Sec-WebSocket-Accept: s3pPLMBiTxaQ9kYGzzhZRbK+xOo=\r\n") != std::string::npos;
+    printf("split: %s, upgraded %d of 1\n", ok ? "101 with the expected key" : "no valid 101", upgraded);
+    return ok && upgraded == 1;
+}
+
+static bool oversized(uint16_t port) {
+    WSServer server(port, 16);
+    int upgraded = 0;
+    server.onConnection([&](WSClient&) { upgraded++; });
+    server.begin();
+
+    test::Peer peer(port);
+    std::string request = test::request;
+    request.insert(request.size() - 2, "X-Padding: " + std::string(WS_MAX_HANDSHAKE_SIZE, 'x') + "\r\n");
+    peer.send(request);
+    std::string response = peer.readResponse(server);
+    bool closed = peer.closed(server);
+    printf("oversized: response \"%.12s\", closed %d, upgraded %d\n", response.c_str(), closed, upgraded);
+    return response.empty() && closed && upgraded == 0;
+}
+
+static bool tooManyHeaders(uint16_t port) {
+    WSServer server(port, 16);
+    int upgraded = 0;
+    server.onConnection([&](WSClient&) { upgraded++; });
+    server.begin();
+
+    test::Peer peer(port);
+    std::string request = test::request;
+    std::string headers;
+    for (int i = 0; i <= WS_MAX_HANDSHAKE_HEADERS; i++) headers += "X-Header-" + std::to_string(i) + ": 1\r\n";
+    request.insert(request.size() - 2, headers);
+    peer.send(request);
+    std::string response = peer.readResponse(server);
+    bool closed = peer.closed(server);
+    printf("too many headers: response \"%.12s\", closed %d, upgraded %d\n", response.c_str(), closed, upgraded);
+    return response.empty() && closed && upgraded == 0;
+}
+
+static bool notUpgrade(uint16_t port) {
+    WSServer server(port, 16);
+    int upgraded = 0;
+    server.onConnection([&](WSClient&) { upgraded++; });
+    server.begin();
+
+    test::Peer peer(port);
+    peer.send("GET / HTTP/1.1\r\nHost: 127.0.0.1\r\n\r\n");
+    std::string response = peer.readResponse(server);
+    bool closed = peer.closed(server);
+    printf("not an upgrade: response \"%.24s\", closed %d, upgraded %d\n", response.c_str(), closed, upgraded);
+    return response.find("HTTP/1.1 400") == 0 && closed && upgraded == 0;
+}
+
+int main(int argc, char** argv) {
+    uint16_t port = bench::option(argc, argv, "port", 8800);
+    bool ok = split(port);
+    ok = oversized(port + 1) && ok;
+    ok = tooManyHeaders(port + 2) && ok;
+    ok = notUpgrade(port + 3) && ok;
+    return ok ? 0 : 1;
+}